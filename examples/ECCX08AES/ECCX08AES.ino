@@ -4,10 +4,12 @@
   This sketch uses the ECC608 to compute
   the AES_128_GCM encryption for some data
 
-  This sketch assumes TempKey has been set
-  (ECDH sketch will do this)
-  and derives a deviceID from the public key
-  corresponding to the key in slot 0.
+  The AES key is established in TempKey by
+  ECDH between the keys in slots 2 and 3
+  followed by HKDF, the shared secret never
+  leaves the chip. The deviceID is derived
+  from the public key corresponding to the
+  key in slot 0.
 
 */
 
@@ -35,6 +37,19 @@ void setup() {
     printHex(devicePubKey, 64);
   }
 
+  // In practice the counterparty public key is received from the peer
+  byte counterPartyPubKey[64];
+  if (!ECCX08.generatePublicKey(3, counterPartyPubKey)){
+    Serial.println("Failed to generate counterparty public key.");
+    while (1);
+  }
+
+  const byte info[] = "ECCX08AES session";
+  if (!ECCX08.AESBeginSession(2, counterPartyPubKey, info, sizeof(info) - 1)){
+    Serial.println("Failed to establish AES session key.");
+    while (1);
+  }
+
   byte ad[20] = {0x14};
   uint64_t adLength = (sizeof(ad));
   Serial.print("AD:  ");
@@ -0,0 +1,86 @@
+/*
+  ECCX08 Base64 Benchmark
+
+  This sketch measures the throughput of the base64 and
+  base64url codecs used for PEM certificates and JWS
+  tokens, and prints the results to the Serial Monitor.
+
+  No ECC508/ECC608 commands are used, the codecs run
+  entirely on the board's CPU.
+
+*/
+
+#include <ArduinoECCX08.h>
+#include <utility/PEMUtils.h>
+
+const int dataLength = 256;
+const int iterations = 200;
+
+byte data[dataLength];
+char encoded[dataLength * 2];
+byte decoded[dataLength];
+
+// discards everything written to it
+class NullPrint : public Print {
+public:
+  virtual size_t write(uint8_t) { return 1; }
+  virtual size_t write(const uint8_t *, size_t size) { return size; }
+};
+
+NullPrint nullPrint;
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+
+  for (int i = 0; i < dataLength; i++) {
+    data[i] = i;
+  }
+
+  unsigned long start = micros();
+  for (int i = 0; i < iterations; i++) {
+    PEMUtils.base64Encode(data, dataLength, "", "", nullPrint);
+  }
+  printResult("base64 encode", micros() - start);
+
+  int encodedLength = PEMUtils.base64Encode(data, dataLength, "", "", encoded, sizeof(encoded));
+
+  start = micros();
+  for (int i = 0; i < iterations; i++) {
+    PEMUtils.base64Decode(encoded, encodedLength, decoded, sizeof(decoded));
+  }
+  printResult("base64 decode", micros() - start);
+
+  start = micros();
+  for (int i = 0; i < iterations; i++) {
+    PEMUtils.base64urlEncode(data, dataLength, nullPrint);
+  }
+  printResult("base64url encode", micros() - start);
+
+  String encodedUrl = PEMUtils.base64urlEncode(data, dataLength);
+
+  start = micros();
+  for (int i = 0; i < iterations; i++) {
+    PEMUtils.base64urlDecode(encodedUrl.c_str(), encodedUrl.length(), decoded, sizeof(decoded));
+  }
+  printResult("base64url decode", micros() - start);
+
+  if (memcmp(data, decoded, dataLength) != 0) {
+    Serial.println("Decoded data does not match!");
+  }
+}
+
+void loop() {
+  // do nothing
+}
+
+void printResult(const char* name, unsigned long elapsed) {
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(elapsed / iterations);
+  Serial.print(" us per ");
+  Serial.print(dataLength);
+  Serial.print(" bytes, ");
+  Serial.print((1000000.0 * dataLength * iterations) / (elapsed * 1024.0));
+  Serial.println(" KB/s");
+}
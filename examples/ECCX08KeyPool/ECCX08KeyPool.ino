@@ -0,0 +1,84 @@
+/*
+  ECCX08 Key Pool
+
+  This sketch keeps a pool of ephemeral ECDH key pairs
+  in spare ECC508/ECC608 slots. Key pairs are generated
+  in loop() while the chip is otherwise idle, so the
+  handshake only pays for the ECDH command itself.
+
+  The slots used by the pool are overwritten, this
+  sketch assumes slots 3 and 4 are configured for ECDH
+  (the default TLS configuration does this).
+
+  Every refill writes a slot's EEPROM. With a handshake
+  every 5 seconds this sketch does 17280 refills a day,
+  split over two slots, so it reaches the rated 400,000
+  writes per slot in about 46 days, a real device
+  should handshake far less often.
+
+*/
+
+#include <ArduinoECCX08.h>
+#include <utility/ECCX08KeyPool.h>
+
+const int poolSlots[] = { 3, 4 };
+
+unsigned long lastHandshake = 0;
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+
+  if (!ECCX08.begin()) {
+    Serial.println("Failed to communicate with ECC508/ECC608!");
+    while (1);
+  }
+
+  if (!ECCX08.locked()) {
+    Serial.println("The ECC508/ECC608 is not locked!");
+    while (1);
+  }
+
+  if (!ECCX08KeyPool.begin(poolSlots, sizeof(poolSlots) / sizeof(poolSlots[0]))) {
+    Serial.println("Failed to set up the key pool!");
+    while (1);
+  }
+}
+
+void loop() {
+  // refill the pool, one key pair per call
+  ECCX08KeyPool.poll();
+
+  if (millis() - lastHandshake < 5000) {
+    return;
+  }
+  lastHandshake = millis();
+
+  // simulate a peer, in practice this comes from the other side of the handshake
+  byte peerPublicKey[64];
+  if (!ECCX08.generatePublicKey(0, peerPublicKey)) {
+    Serial.println("Failed to get peer public key.");
+    return;
+  }
+
+  byte ephemeralPublicKey[64];
+  unsigned long start = millis();
+  int slot = ECCX08KeyPool.acquire(ephemeralPublicKey);
+
+  if (slot < 0) {
+    Serial.println("Failed to acquire an ephemeral key.");
+    return;
+  }
+
+  byte sharedSecret[32];
+  if (!ECCX08.ecdh(slot, ECDH_MODE_OUTPUT, peerPublicKey, sharedSecret)) {
+    Serial.println("The ecdh function failed!");
+  } else {
+    Serial.print("Handshake took ");
+    Serial.print(millis() - start);
+    Serial.println(" ms");
+  }
+
+  // the ephemeral key is spent, let poll() regenerate it
+  ECCX08KeyPool.release(slot);
+}
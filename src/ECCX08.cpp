@@ -27,10 +27,37 @@ const uint32_t ECCX08Class::_normalFrequency = 400000u;  // 400 kHz
 #else
 const uint32_t ECCX08Class::_normalFrequency = 1000000u; // 1 MHz
 #endif
+const int ECCX08Class::_aesBatchMax = 16;
+
+// Multiplication by x in GF(2^128), used for the CMAC subkeys
+static void AESDoubleBlock(byte block[])
+{
+  byte carry = block[0] & 0x80;
+
+  for (int i = 0; i < 15; i++) {
+    block[i] = (block[i] << 1) | (block[i + 1] >> 7);
+  }
+  block[15] <<= 1;
+
+  if (carry) {
+    block[15] ^= 0x87;
+  }
+}
 
 ECCX08Class::ECCX08Class(TwoWire& wire, uint8_t address) :
   _wire(&wire),
-  _address(address)
+  _address(address),
+  _privateKeyGeneration(),
+  _tempKeySource(TEMPKEY_SOURCE_NONE),
+  _tempKeySlot(-1),
+  _tempKeyGeneration(0),
+  _aesKeyId(AES_KEY_TEMPKEY),
+  _aesKeyBlock(0),
+  _aesKeyGeneration(0),
+  _aesBatchBlocks(0),
+  _aesBatchStart(0),
+  _ivLeaseBits(0),
+  _ivRemaining(0)
 {
 }
 
@@ -46,6 +73,9 @@ int ECCX08Class::begin(uint8_t i2cAddress)
 
 int ECCX08Class::begin()
 {
+  _ivRemaining = 0;
+  tempKeyInvalidate();
+
   _wire->begin();
 
   wakeup();
@@ -181,6 +211,16 @@ int ECCX08Class::generatePrivateKey(int slot, byte publicKey[])
     return 0;
   }
 
+  // the slot may hold a new key even if the response gets lost
+  if (slot >= 0 && slot < 16) {
+    _privateKeyGeneration[slot]++;
+  }
+
+  // the IV device ID is derived from the key in slot 0
+  if (slot == 0) {
+    _ivRemaining = 0;
+  }
+
   delay(115);
 
   if (!receiveResponse(publicKey, 64)) {
@@ -217,6 +257,23 @@ int ECCX08Class::generatePublicKey(int slot, byte publicKey[])
   return 1;
 }
 
+/** \brief Identifies the private key in a slot, the value
+ *   changes whenever generatePrivateKey replaces that key, so
+ *   public keys cached elsewhere can be dropped.
+ *
+ * \param[in] slot               Key slot (0 to 15)
+ *
+ * \return The slot's generation, 0 for an invalid slot.
+ */
+uint8_t ECCX08Class::privateKeyGeneration(int slot)
+{
+  if (slot < 0 || slot > 15) {
+    return 0;
+  }
+
+  return _privateKeyGeneration[slot];
+}
+
 int ECCX08Class::ecdsaVerify(const byte message[], const byte signature[], const byte pubkey[])
 {
   if (!challenge(message)) {
@@ -352,6 +409,79 @@ int ECCX08Class::ecdh(int slot, byte mode, const byte pubKeyXandY[], byte output
     if (!receiveResponse(output, 1)) {
       return 0;
     }
+
+    if (output[0] == 0) {
+      tempKeyLoaded(TEMPKEY_SOURCE_ECDH, slot);
+    }
+  }
+
+  delay(1);
+  idle();
+
+  return 1;
+}
+
+/** \brief Key derivation function, ATECC608 only.
+ *
+ * \param[in] mode               KDF mode (algorithm, source and target)
+ * \param[in] keyId              Source and target key slots
+ * \param[in] details            Algorithm specific details
+ * \param[in] message            Input message
+ * \param[in] length             The length of message
+ * \param[out] output            Derived key (32 bytes) when the target
+ *                               is KDF_MODE_TARGET_OUTPUT
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::kdf(byte mode, uint16_t keyId, uint32_t details, const byte message[], int length, byte output[])
+{
+  // KDF is only available on the ATECC608
+  long ecc608ver = 0x0600000;
+  long eccCurrVer = version() & 0x0F00000;
+
+  if (eccCurrVer != ecc608ver) {
+    return 0;
+  }
+
+  if (length < 0 || length > 128) {
+    return 0;
+  }
+
+  if (!wakeup()) {
+    return 0;
+  }
+
+  byte data[4 + length];
+  memcpy(&data[0], &details, sizeof(details));
+  memcpy(&data[4], message, length);
+
+  // sending the command invalidates the TempKey provenance, keep
+  // the slot a TempKey source came from
+  int8_t tempKeySlot = _tempKeySlot;
+
+  if (!sendCommand(0x56, mode, keyId, data, sizeof(data))) {
+    return 0;
+  }
+
+  delay(165);
+
+  if ((mode & 0x1c) == KDF_MODE_TARGET_OUTPUT) {
+    if (!receiveResponse(output, 32)) {
+      return 0;
+    }
+  } else {
+    uint8_t status;
+
+    if (!receiveResponse(&status, sizeof(status))) {
+      return 0;
+    }
+
+    if (status != 0) {
+      return 0;
+    }
+
+    // a key derived from TempKey keeps the slot it came from
+    tempKeyLoaded(TEMPKEY_SOURCE_KDF, ((mode & 0x03) == KDF_MODE_SOURCE_TEMPKEY) ? tempKeySlot : -1);
   }
 
   delay(1);
@@ -360,9 +490,119 @@ int ECCX08Class::ecdh(int slot, byte mode, const byte pubKeyXandY[], byte output
   return 1;
 }
 
+/** \brief Establishes an AES session key in TempKey.
+ *
+ * Runs ECDH with the private key in slot into TempKey and,
+ * when info is given, HKDF(TempKey, info) back into TempKey.
+ * The shared secret never leaves the chip, the following
+ * AES calls use the derived key directly.
+ *
+ * \param[in] slot               Private key slot (ECDH enabled)
+ * \param[in] pubKeyXandY        Public key of the peer
+ *                               (64 bytes)
+ * \param[in] info               Optional KDF context information
+ * \param[in] infoLength         The length of info
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESBeginSession(int slot, const byte pubKeyXandY[], const byte info[], int infoLength)
+{
+  uint8_t status;
+
+  if (!ecdh(slot, ECDH_MODE_TEMPKEY, pubKeyXandY, &status) || status != 0) {
+    Serial.println("AESBeginSession: failed to compute shared secret.");
+    return 0;
+  }
+
+  // the session key lives in TempKey
+  AESSetKey(AES_KEY_TEMPKEY);
+
+  if (info != NULL && infoLength > 0) {
+    uint32_t details = KDF_DETAILS_HKDF_MSG_LOC_INPUT | ((uint32_t)infoLength << 24);
+
+    if (!kdf(KDF_MODE_ALG_HKDF | KDF_MODE_SOURCE_TEMPKEY | KDF_MODE_TARGET_TEMPKEY, 0x0000, details, info, infoLength, NULL)) {
+      Serial.println("AESBeginSession: failed to derive session key.");
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/** \brief Derives an AES session key for software AES_GCM,
+ *   ATECC608 only.
+ *
+ * Same derivation as AESBeginSession, but the HKDF result is
+ * returned instead of kept in TempKey, so bulk data can be
+ * encrypted at CPU speed. The ECDH shared secret and the private
+ * key stay on the chip, the derived key should be cleared with
+ * AES128Clear when the session ends.
+ *
+ * \param[in] slot               Private key slot (ECDH enabled)
+ * \param[in] pubKeyXandY        Public key of the peer
+ *                               (64 bytes)
+ * \param[in] info               KDF context information
+ * \param[in] infoLength         The length of info
+ * \param[out] key               Expanded AES key
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESDeriveSessionKey(int slot, const byte pubKeyXandY[], const byte info[], int infoLength, AES128_CTX& key)
+{
+  uint8_t status;
+
+  if (!ecdh(slot, ECDH_MODE_TEMPKEY, pubKeyXandY, &status) || status != 0) {
+    Serial.println("AESDeriveSessionKey: failed to compute shared secret.");
+    return 0;
+  }
+
+  byte output[32];
+  uint32_t details = KDF_DETAILS_HKDF_MSG_LOC_INPUT | ((uint32_t)infoLength << 24);
+
+  if (!kdf(KDF_MODE_ALG_HKDF | KDF_MODE_SOURCE_TEMPKEY | KDF_MODE_TARGET_OUTPUT, 0x0000, details, info, infoLength, output)) {
+    Serial.println("AESDeriveSessionKey: failed to derive session key.");
+    return 0;
+  }
+
+  // the chip uses the first 16 bytes of a key as AES-128 key
+  AES128Init(&key, output);
+  memset(output, 0x00, sizeof(output));
+
+  return 1;
+}
+
+/** \brief Selects the key used by all AES operations.
+ *
+ * Keys in a data slot survive other commands (SHA, ECDH, Nonce...)
+ * that overwrite TempKey, so they do not need to be reloaded.
+ *
+ * \param[in] keyId              Key slot (0 to 15) or
+ *                               AES_KEY_TEMPKEY
+ * \param[in] keyBlock           Index of the 16 byte key
+ *                               within the slot (0 to 3)
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESSetKey(uint16_t keyId, int keyBlock)
+{
+  if (keyId > 15 && keyId != AES_KEY_TEMPKEY) {
+    return 0;
+  }
+
+  if (keyBlock < 0 || keyBlock > 3) {
+    return 0;
+  }
+
+  _aesKeyId = keyId;
+  _aesKeyBlock = keyBlock;
+  _aesKeyGeneration++;
+
+  return 1;
+}
+
 /** \brief AES_GCM encryption function, see
  *   NIST Special Publication 800-38D
- *   7.1, using TempKey.
+ *   7.1, using the current AES key.
  *
  * \param[out] IV                 Initialization vector
  *                                (12 bytes)
@@ -378,58 +618,28 @@ int ECCX08Class::ecdh(int slot, byte mode, const byte pubKeyXandY[], byte output
  */
 int ECCX08Class::AESEncrypt(byte IV[], byte ad[], byte pt[], byte ct[], byte tag[], const uint64_t adLength, const uint64_t ptLength)
 {
-  byte H[16] = {0x00};
-  if (!AESBlockEncrypt(H)){
-    Serial.println("AESEncrypt: failed to compute H.");
-    return 0;
-  }
-
-  byte J0[16] = {0x00};
   if (!AESGenIV(IV)){
     Serial.println("AESEncrypt: failed to generate IV.");
     return 0;
   }
-  memcpy(J0, IV, 12);
-  J0[15] = 0x01;
 
-  byte counterBlock[16];
-  memcpy(counterBlock, J0, 16);
-  if (!AESIncrementBlock(counterBlock)){
-    Serial.println("AESEncrypt: failed to increment counter block.");
+  AESGCMContext ctx;
+  if (!AESGCMBegin(ctx, IV)){
+    Serial.println("AESEncrypt: failed to compute H.");
     return 0;
   }
 
-  if (!AESGCTR(counterBlock, pt, ct, ptLength)){
-    Serial.println("AESEncrypt: failed to encrypt.");
+  if (!AESGCMUpdateAAD(ctx, ad, adLength)){
+    Serial.println("AESEncrypt: failed to compute GHASH.");
     return 0;
   }
 
-  int adPad = (-adLength) % 16;
-  int ctPad = (-ptLength) % 16;
-
-  byte S[16];
-  uint64_t inputLength = adLength+adPad+ptLength+ctPad+16;
-  byte input[inputLength];
-  memcpy(input, ad, adLength);
-  memset(input+adLength, 0, adPad);
-  memcpy(input+adLength+adPad, ct, ptLength);
-  memset(input+adLength+adPad+ptLength, 0, ctPad);
-  // Device is little endian.
-  // GCM specification requires big endian representation
-  // of bit length.
-  // Hence we multiply by 8 and
-  // reverse the byte order of adLength and ptLength.
-  for (int i=0; i<8; i++){
-    input[adLength+adPad+ptLength+ctPad+i] = (adLength*8 >> (56-8*i)) & 0xFF;
-    input[adLength+adPad+ptLength+ctPad+8+i] = (ptLength*8 >> (56-8*i)) & 0xFF;
-  }
-
-  if (!AESGHASH(H, input, S, inputLength)){
-    Serial.println("AESEncrypt: failed to compute GHASH.");
+  if (!AESGCMEncrypt(ctx, pt, ct, ptLength)){
+    Serial.println("AESEncrypt: failed to encrypt.");
     return 0;
   }
 
-  if (!AESGCTR(J0, S, tag, 16)){
+  if (!AESGCMEnd(ctx, tag)){
     Serial.println("AESEncrypt: failed to compute tag.");
     return 0;
   }
@@ -439,7 +649,10 @@ int ECCX08Class::AESEncrypt(byte IV[], byte ad[], byte pt[], byte ct[], byte tag
 
 /** \brief AES_GCM decryption function, see
  *   NIST Special Publication 800-38D
- *   7.2, using TempKey.
+ *   7.2, using the current AES key.
+ *
+ *   The tag is verified before any plaintext
+ *   is written.
  *
  * \param[in] IV                 Initialization vector
  *                               (12 bytes)
@@ -460,168 +673,1126 @@ int ECCX08Class::AESDecrypt(byte IV[], byte ad[], byte pt[], byte ct[], byte tag
     return 0;
   }
 
-  byte H[16] = {0x00};
-  if (!AESBlockEncrypt(H)){
+  AESGCMContext ctx;
+  if (!AESGCMBegin(ctx, IV)){
     return 0;
   }
 
-  byte J0[16] = {0x00};
-  memcpy(J0, IV, 12);
-  J0[15] = 0x01;
-
-  int adPad = (-adLength) % 16;
-  int ctPad = (-ctLength) % 16;
-
-  byte S[16];
-  uint64_t inputLength = adLength+adPad+ctLength+ctPad+16;
-  byte input[inputLength];
-  memcpy(input, ad, adLength);
-  memset(input+adLength, 0, adPad);
-  memcpy(input+adLength+adPad, ct, ctLength);
-  memset(input+adLength+adPad+ctLength, 0, ctPad);
-  // Device is little endian.
-  // GCM specification requires big endian representation
-  // of bit length.
-  // Hence we multiply by 8 and
-  // reverse the byte order of adLength and ptLength.
-  for (int i=0; i<8; i++){
-    input[adLength+adPad+ctLength+ctPad+i] = (adLength*8 >> (56-8*i)) & 0xFF;
-    input[adLength+adPad+ctLength+ctPad+8+i] = (ctLength*8 >> (56-8*i)) & 0xFF;
-  }
-
-  if (!AESGHASH(H, input, S, inputLength)){
+  if (!AESGCMUpdateAAD(ctx, ad, adLength)){
     return 0;
   }
 
-  byte tagComputed[16];
-  if (!AESGCTR(J0, S, tagComputed, 16)){
+  // authenticate the ciphertext first
+  if (!AESGCMHashPad(ctx)){
     return 0;
   }
+  ctx.aadDone = true;
 
-  uint8_t equalBytes=0;
-  for (int i=0; i<16; i++){
-    equalBytes += (tag[i]==tagComputed[i]);
-  }
-  if (equalBytes!=16){
-    // tag mismatch
+  if (!AESGCMHash(ctx, ct, ctLength)){
     return 0;
   }
+  ctx.textLength = ctLength;
 
-  byte counterBlock[16];
-  memcpy(counterBlock, J0, 16);
-  if (!AESIncrementBlock(counterBlock)){
+  if (!AESGCMEndVerify(ctx, tag)){
+    // tag mismatch
     return 0;
   }
 
-  if (!AESGCTR(counterBlock, ct, pt, ctLength)){
+  // the counter is still at inc32(J0)
+  if (!AESGCMCounter(ctx, ct, pt, ctLength)){
     return 0;
   }
 
   return 1;
 }
 
-
-/** \brief GCTR function, see
- *   NIST Special Publication 800-38D
- *   6.5
+/** \brief Two-pass AES_GCM decryption of a ciphertext that
+ *   does not fit in RAM, using the current AES key.
  *
- * \param[in,out] counterBlock    The initial counter block
- *                                (16 bytes).
- * \param[in] input               The input bit string
- * \param[out] output             The output bit string
- * \param[in] inputLength         The length of the input
+ *   The first pass reads the whole ciphertext to verify the tag,
+ *   the second pass reads it again and writes the plaintext to out.
+ *   Nothing is written unless the tag matches. read must return
+ *   the same data in both passes (e.g. a File rewound with seek).
+ *
+ * \param[in] IV                 Initialization vector
+ *                               (12 bytes)
+ * \param[in] ad                 Associated data
+ * \param[in] adLength           The length of ad
+ * \param[in] read               Reads length bytes of ciphertext
+ *                               at offset into buffer, returns the
+ *                               number of bytes read
+ * \param[in] arg                Passed through to read
+ * \param[in] ctLength           The length of the ciphertext
+ * \param[in] tag                Authentication tag
+ *                               (16 bytes)
+ * \param[out] out               Receives the plaintext
  *
  * \return 1 on success, otherwise 0.
  */
-int ECCX08Class::AESGCTR(byte counterBlock[], byte input[], byte output[], const uint64_t inputLength)
+int ECCX08Class::AESDecrypt(const byte IV[], const byte ad[], const uint64_t adLength, AESReadCallback read, void* arg, const uint64_t ctLength, const byte tag[], Print& out)
 {
-  if(inputLength == 0){
-    return 1;
+  uint64_t maxLength = 1ull << 36;
+  if (adLength >= maxLength || ctLength >= maxLength){
+    return 0;
   }
-  int remainder = inputLength % 16;
-  int n = inputLength / 16 + (remainder != 0);
 
-  int i;
-  for (i=0; i<n-1; i++){
-    byte temp[16];
-    memcpy(temp, counterBlock, 16);
+  AESGCMContext ctx;
+  if (!AESGCMBegin(ctx, IV)){
+    return 0;
+  }
 
-    if (!AESBlockEncrypt(temp)){
-      Serial.println("AESGCTR: failed to encrypt counter block.");
-      return 0;
+  if (!AESGCMUpdateAAD(ctx, ad, adLength)){
+    return 0;
+  }
+
+  if (!AESGCMHashPad(ctx)){
+    return 0;
+  }
+  ctx.aadDone = true;
+
+  // first pass, authenticate
+  byte buffer[ECCX08_AES_STREAM_BUFFER_SIZE];
+  uint64_t offset;
+  for (offset = 0; offset < ctLength; ){
+    size_t length = sizeof(buffer);
+    if (ctLength - offset < length){
+      length = ctLength - offset;
     }
 
-    for (int j=0; j<16; j++){
-      output[16*i+j] = input[16*i+j]^temp[j];
+    if (read(arg, offset, buffer, length) != length){
+      return 0;
     }
 
-    if (!AESIncrementBlock(counterBlock)){
-      Serial.println("AESGCTR: failed to increment counter block.");
+    if (!AESGCMHash(ctx, buffer, length)){
       return 0;
     }
+    offset += length;
   }
-  byte temp[16];
-  memcpy(temp, counterBlock, 16);
+  ctx.textLength = ctLength;
 
-  if (!AESBlockEncrypt(temp)){
-    Serial.println("AESGCTR: failed to encrypt counter block.");
+  if (!AESGCMEndVerify(ctx, tag)){
+    // tag mismatch
     return 0;
   }
 
-  remainder = (remainder == 0) ? 16 : remainder;
-  for (int j=0; j<remainder; j++){
-    output[16*i+j] = input[16*i+j]^temp[j];
+  // second pass, decrypt, the counter is still at inc32(J0)
+  for (offset = 0; offset < ctLength; ){
+    size_t length = sizeof(buffer);
+    if (ctLength - offset < length){
+      length = ctLength - offset;
+    }
+
+    if (read(arg, offset, buffer, length) != length){
+      return 0;
+    }
+
+    if (!AESGCMCounter(ctx, buffer, buffer, length)){
+      return 0;
+    }
+
+    if (out.write(buffer, length) != length){
+      memset(buffer, 0x00, sizeof(buffer));
+      return 0;
+    }
+    offset += length;
   }
+  memset(buffer, 0x00, sizeof(buffer));
 
   return 1;
 }
 
-/** \brief GHASH function, see
+/** \brief Starts a streaming AES_GCM operation, see
  *   NIST Special Publication 800-38D
- *   6.4
+ *   7.1 and 7.2, using the current AES key.
  *
- * \param[in] H                   The hash subkey H
- *                                (16 bytes).
- * \param[in] input               The input bit string
- * \param[out] output             The output block
- *                                (16 bytes)
- * \param[in] inputLength         The length of the input
+ *   Associated data, plaintext and ciphertext are
+ *   processed incrementally, nothing is buffered
+ *   beyond a single block.
+ *
+ * \param[out] ctx               GCM context
+ * \param[in] IV                 Initialization vector
+ *                               (12 bytes)
  *
  * \return 1 on success, otherwise 0.
  */
-int ECCX08Class::AESGHASH(byte H[], byte input[], byte output[], const uint64_t inputLength)
+int ECCX08Class::AESGCMBegin(AESGCMContext& ctx, const byte IV[])
 {
-  if (inputLength % 16 != 0){
-    Serial.println("GHASH is only defined for multiples of 16 bytes.");
+  memset(&ctx, 0x00, sizeof(ctx));
+  ctx.keyGeneration = _aesKeyGeneration;
+
+  return AESGCMStart(ctx, IV);
+}
+
+/** \brief Starts a streaming AES_GCM operation that runs the
+ *   block cipher in software, e.g. with a session key from
+ *   AESDeriveSessionKey. The output is identical to the chip
+ *   based AES_GCM with the same key.
+ *
+ * \param[out] ctx               GCM context
+ * \param[in] IV                 Initialization vector
+ *                               (12 bytes)
+ * \param[in] key                Expanded AES key, must stay
+ *                               valid while ctx is used
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESGCMBegin(AESGCMContext& ctx, const byte IV[], const AES128_CTX& key)
+{
+  memset(&ctx, 0x00, sizeof(ctx));
+  ctx.softwareKey = &key;
+
+  return AESGCMStart(ctx, IV);
+}
+
+/** \brief Adds associated data to a streaming AES_GCM
+ *   operation. Must be called before any plaintext or
+ *   ciphertext is processed, can be called repeatedly.
+ *
+ * \param[in,out] ctx            GCM context
+ * \param[in] ad                 Associated data
+ * \param[in] length             The length of ad
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESGCMUpdateAAD(AESGCMContext& ctx, const byte ad[], size_t length)
+{
+  if (ctx.aadDone){
     return 0;
   }
 
-  memset(output, 0, 16);
-  for (int i=0; i< inputLength/16; i++){
-    for (int j=0; j<16; j++){
-      output[j] ^= input[16*i+j];
-    }
-    if (!AESBlockMultiplication(H, output)){
-      return 0;
-    }
+  if (ctx.adLength + length >= (1ull << 36)){
+    return 0;
+  }
+
+  if (!AESGCMHash(ctx, ad, length)){
+    return 0;
   }
+  ctx.adLength += length;
+
   return 1;
 }
 
-/** \brief Increments the right-most 32 bits of the block
- * regarded as an integer mod 2^32
+/** \brief Encrypts the next part of the plaintext
  *
- * \param[in,out] counterBlock  The block to be incremented
- *                              (16 bytes). See
- *                              NIST Special Publication 800-38D
- *                              6.2
+ * \param[in,out] ctx            GCM context
+ * \param[in] pt                 Plaintext
+ * \param[out] ct                Ciphertext, may be the same
+ *                               buffer as pt
+ * \param[in] length             The length of pt
  *
  * \return 1 on success, otherwise 0.
  */
-int ECCX08Class::AESIncrementBlock(byte counterBlock[])
+int ECCX08Class::AESGCMEncrypt(AESGCMContext& ctx, const byte pt[], byte ct[], size_t length)
 {
-// Increment the big-endian counter value
-  int i;
+  if (ctx.softwareKey == NULL && !AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  if (ctx.textLength + length >= (1ull << 36)){
+    return 0;
+  }
+
+  if (!ctx.aadDone){
+    if (!AESGCMHashPad(ctx)){
+      return 0;
+    }
+    ctx.aadDone = true;
+  }
+
+  if (!AESGCMCounter(ctx, pt, ct, length)){
+    return 0;
+  }
+
+  if (!AESGCMHash(ctx, ct, length)){
+    return 0;
+  }
+  ctx.textLength += length;
+
+  return 1;
+}
+
+/** \brief Decrypts the next part of the ciphertext.
+ *   The plaintext must not be trusted before
+ *   AESGCMEndVerify succeeded.
+ *
+ * \param[in,out] ctx            GCM context
+ * \param[in] ct                 Ciphertext
+ * \param[out] pt                Plaintext, may be the same
+ *                               buffer as ct
+ * \param[in] length             The length of ct
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESGCMDecrypt(AESGCMContext& ctx, const byte ct[], byte pt[], size_t length)
+{
+  if (ctx.softwareKey == NULL && !AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  if (ctx.textLength + length >= (1ull << 36)){
+    return 0;
+  }
+
+  if (!ctx.aadDone){
+    if (!AESGCMHashPad(ctx)){
+      return 0;
+    }
+    ctx.aadDone = true;
+  }
+
+  // hash before decrypting, ct and pt may overlap
+  if (!AESGCMHash(ctx, ct, length)){
+    return 0;
+  }
+
+  if (!AESGCMCounter(ctx, ct, pt, length)){
+    return 0;
+  }
+  ctx.textLength += length;
+
+  return 1;
+}
+
+/** \brief Finishes a streaming AES_GCM operation
+ *
+ * \param[in,out] ctx            GCM context
+ * \param[out] tag               Authentication tag
+ *                               (16 bytes)
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESGCMEnd(AESGCMContext& ctx, byte tag[])
+{
+  if (ctx.softwareKey == NULL && !AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  if (!AESGCMHashPad(ctx)){
+    return 0;
+  }
+
+  // GCM specification requires big endian representation
+  // of the bit lengths.
+  byte lengths[16];
+  for (int i=0; i<8; i++){
+    lengths[i] = (ctx.adLength*8 >> (56-8*i)) & 0xFF;
+    lengths[8+i] = (ctx.textLength*8 >> (56-8*i)) & 0xFF;
+  }
+
+  if (!AESGCMHash(ctx, lengths, sizeof(lengths))){
+    return 0;
+  }
+
+  byte temp[16];
+  memcpy(temp, ctx.J0, 16);
+  if (!AESGCMBlock(ctx, temp)){
+    return 0;
+  }
+  AESBatchEnd();
+
+  for (int i=0; i<16; i++){
+    tag[i] = ctx.S[i]^temp[i];
+  }
+
+  return 1;
+}
+
+/** \brief Finishes a streaming AES_GCM decryption
+ *   and checks the authentication tag.
+ *
+ * \param[in,out] ctx            GCM context
+ * \param[in] tag                Expected authentication tag
+ *                               (16 bytes)
+ *
+ * \return 1 if the tag matches, otherwise 0.
+ */
+int ECCX08Class::AESGCMEndVerify(AESGCMContext& ctx, const byte tag[])
+{
+  byte tagComputed[16];
+  if (!AESGCMEnd(ctx, tagComputed)){
+    return 0;
+  }
+
+  uint8_t diff = 0;
+  for (int i=0; i<16; i++){
+    diff |= (tag[i]^tagComputed[i]);
+  }
+
+  return (diff == 0);
+}
+
+
+/** \brief Precomputes keystream for the next part of a
+ *   streaming AES_GCM operation, e.g. while the application
+ *   is idle. The following AESGCMEncrypt/AESGCMDecrypt calls
+ *   consume it before talking to the chip again.
+ *
+ * \param[in,out] ctx            GCM context
+ * \param[out] buffer            Keystream storage, must stay
+ *                               valid until it is consumed
+ * \param[in] length             The length of buffer,
+ *                               a multiple of 16
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESGCMPrecompute(AESGCMContext& ctx, byte buffer[], size_t length)
+{
+  if (ctx.softwareKey == NULL && !AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  if (length % 16 != 0 || ctx.precomputedUsed < ctx.precomputedLength){
+    return 0;
+  }
+
+  for (size_t i=0; i<length/16; i++){
+    memcpy(&buffer[16*i], ctx.counterBlock, 16);
+
+    if (!AESGCMBlock(ctx, &buffer[16*i]) || !AESIncrementBlock(ctx.counterBlock)){
+      AESBatchEnd();
+      return 0;
+    }
+  }
+  AESBatchEnd();
+
+  ctx.precomputed = buffer;
+  ctx.precomputedLength = length;
+  ctx.precomputedUsed = 0;
+
+  return 1;
+}
+
+/** \brief Starts an AES_CMAC computation, see
+ *   NIST Special Publication 800-38B, using the current AES key.
+ *
+ * \param[out] ctx               CMAC context
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCMACBegin(AESCMACContext& ctx)
+{
+  memset(&ctx, 0x00, sizeof(ctx));
+  ctx.keyGeneration = _aesKeyGeneration;
+
+  return 1;
+}
+
+/** \brief Adds data to an AES_CMAC computation
+ *
+ * \param[in,out] ctx            CMAC context
+ * \param[in] data               Message data
+ * \param[in] length             The length of data
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCMACUpdate(AESCMACContext& ctx, const byte data[], size_t length)
+{
+  if (!AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  while (length--){
+    // the last block gets special treatment in AESCMACEnd,
+    // so a full block is only processed once more data follows
+    if (ctx.bufferLength == 16){
+      for (int i=0; i<16; i++){
+        ctx.X[i] ^= ctx.buffer[i];
+      }
+
+      if (!AESBatchCommand(0x00, ctx.X)){
+        return 0;
+      }
+      ctx.bufferLength = 0;
+    }
+
+    ctx.buffer[ctx.bufferLength++] = *data++;
+  }
+  AESBatchEnd();
+
+  return 1;
+}
+
+/** \brief Finishes an AES_CMAC computation
+ *
+ * \param[in,out] ctx            CMAC context
+ * \param[out] mac               Message authentication code
+ *                               (16 bytes)
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCMACEnd(AESCMACContext& ctx, byte mac[])
+{
+  if (!AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  // subkey generation, K1 = dbl(L), K2 = dbl(K1)
+  byte K[16] = {0x00};
+  if (!AESBatchCommand(0x00, K)){
+    return 0;
+  }
+  AESDoubleBlock(K);
+
+  if (ctx.bufferLength < 16){
+    AESDoubleBlock(K);
+
+    ctx.buffer[ctx.bufferLength] = 0x80;
+    memset(&ctx.buffer[ctx.bufferLength + 1], 0x00, 15 - ctx.bufferLength);
+  }
+
+  for (int i=0; i<16; i++){
+    ctx.X[i] ^= ctx.buffer[i]^K[i];
+  }
+  memset(K, 0x00, sizeof(K));
+
+  if (!AESBatchCommand(0x00, ctx.X)){
+    return 0;
+  }
+  AESBatchEnd();
+
+  memcpy(mac, ctx.X, 16);
+
+  return 1;
+}
+
+/** \brief Finishes an AES_CMAC computation and checks the
+ *   (possibly truncated) message authentication code.
+ *
+ * \param[in,out] ctx            CMAC context
+ * \param[in] mac                Expected message authentication code
+ * \param[in] macLength          The length of mac (1 to 16 bytes)
+ *
+ * \return 1 if the code matches, otherwise 0.
+ */
+int ECCX08Class::AESCMACEndVerify(AESCMACContext& ctx, const byte mac[], int macLength)
+{
+  if (macLength < 1 || macLength > 16){
+    return 0;
+  }
+
+  byte macComputed[16];
+  if (!AESCMACEnd(ctx, macComputed)){
+    return 0;
+  }
+
+  uint8_t diff = 0;
+  for (int i=0; i<macLength; i++){
+    diff |= (mac[i]^macComputed[i]);
+  }
+
+  return (diff == 0);
+}
+
+/** \brief Starts a streaming AES_CCM operation, see
+ *   NIST Special Publication 800-38C, using the current AES key.
+ *
+ *   CCM needs all lengths up front, the data itself
+ *   is processed incrementally.
+ *
+ * \param[out] ctx               CCM context
+ * \param[in] nonce              Nonce
+ * \param[in] nonceLength        The length of nonce (7 to 13 bytes)
+ * \param[in] adLength           Total length of the associated data
+ * \param[in] textLength         Total length of the plaintext
+ * \param[in] tagLength          The length of the tag
+ *                               (4, 6, 8, 10, 12, 14 or 16 bytes)
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCCMBegin(AESCCMContext& ctx, const byte nonce[], int nonceLength, uint64_t adLength, uint64_t textLength, int tagLength)
+{
+  if (nonceLength < 7 || nonceLength > 13){
+    return 0;
+  }
+
+  if (tagLength < 4 || tagLength > 16 || (tagLength % 2) != 0){
+    return 0;
+  }
+
+  int L = 15 - nonceLength;
+  if (L < 8 && (textLength >> (8*L)) != 0){
+    return 0;
+  }
+
+  memset(&ctx, 0x00, sizeof(ctx));
+  ctx.keyGeneration = _aesKeyGeneration;
+  ctx.tagLength = tagLength;
+  ctx.adLength = adLength;
+  ctx.textLength = textLength;
+  ctx.keystreamUsed = 16;
+
+  // B0 = flags | nonce | Q
+  byte B0[16];
+  B0[0] = ((adLength > 0) ? 0x40 : 0x00) | (((tagLength - 2) / 2) << 3) | (L - 1);
+  memcpy(&B0[1], nonce, nonceLength);
+  for (int i=0; i<L; i++){
+    B0[15-i] = (i < 8) ? ((textLength >> (8*i)) & 0xFF) : 0x00;
+  }
+
+  // A0 = flags | nonce | 0, A1 is the first counter block
+  ctx.counterBlock[0] = L - 1;
+  memcpy(&ctx.counterBlock[1], nonce, nonceLength);
+
+  if (!AESCCMMac(ctx, B0, sizeof(B0))){
+    return 0;
+  }
+
+  if (adLength > 0){
+    byte encodedLength[10];
+    int encodedLengthLength;
+
+    if (adLength < 0xFF00){
+      encodedLength[0] = (adLength >> 8) & 0xFF;
+      encodedLength[1] = adLength & 0xFF;
+      encodedLengthLength = 2;
+    } else if (adLength <= 0xFFFFFFFFull){
+      encodedLength[0] = 0xFF;
+      encodedLength[1] = 0xFE;
+      for (int i=0; i<4; i++){
+        encodedLength[5-i] = (adLength >> (8*i)) & 0xFF;
+      }
+      encodedLengthLength = 6;
+    } else {
+      encodedLength[0] = 0xFF;
+      encodedLength[1] = 0xFF;
+      for (int i=0; i<8; i++){
+        encodedLength[9-i] = (adLength >> (8*i)) & 0xFF;
+      }
+      encodedLengthLength = 10;
+    }
+
+    if (!AESCCMMac(ctx, encodedLength, encodedLengthLength)){
+      return 0;
+    }
+  }
+  AESBatchEnd();
+
+  return 1;
+}
+
+/** \brief Adds associated data to a streaming AES_CCM
+ *   operation. Must be called before any plaintext or
+ *   ciphertext is processed, can be called repeatedly.
+ *
+ * \param[in,out] ctx            CCM context
+ * \param[in] ad                 Associated data
+ * \param[in] length             The length of ad
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCCMUpdateAAD(AESCCMContext& ctx, const byte ad[], size_t length)
+{
+  if (!AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  if (ctx.aadDone || length > ctx.adLength - ctx.adProcessed){
+    return 0;
+  }
+
+  if (!AESCCMMac(ctx, ad, length)){
+    return 0;
+  }
+  AESBatchEnd();
+  ctx.adProcessed += length;
+
+  return 1;
+}
+
+/** \brief Encrypts the next part of the plaintext
+ *
+ * \param[in,out] ctx            CCM context
+ * \param[in] pt                 Plaintext
+ * \param[out] ct                Ciphertext, may be the same
+ *                               buffer as pt
+ * \param[in] length             The length of pt
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCCMEncrypt(AESCCMContext& ctx, const byte pt[], byte ct[], size_t length)
+{
+  if (!AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  if (!AESCCMStartText(ctx, length)){
+    return 0;
+  }
+
+  // the MAC covers the plaintext, ct and pt may overlap
+  if (!AESCCMMac(ctx, pt, length)){
+    return 0;
+  }
+
+  if (!AESCCMCounter(ctx, pt, ct, length)){
+    return 0;
+  }
+  AESBatchEnd();
+  ctx.textProcessed += length;
+
+  return 1;
+}
+
+/** \brief Decrypts the next part of the ciphertext.
+ *   The plaintext must not be trusted before
+ *   AESCCMEndVerify succeeded.
+ *
+ * \param[in,out] ctx            CCM context
+ * \param[in] ct                 Ciphertext
+ * \param[out] pt                Plaintext, may be the same
+ *                               buffer as ct
+ * \param[in] length             The length of ct
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCCMDecrypt(AESCCMContext& ctx, const byte ct[], byte pt[], size_t length)
+{
+  if (!AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  if (!AESCCMStartText(ctx, length)){
+    return 0;
+  }
+
+  if (!AESCCMCounter(ctx, ct, pt, length)){
+    return 0;
+  }
+
+  if (!AESCCMMac(ctx, pt, length)){
+    return 0;
+  }
+  AESBatchEnd();
+  ctx.textProcessed += length;
+
+  return 1;
+}
+
+/** \brief Finishes a streaming AES_CCM operation
+ *
+ * \param[in,out] ctx            CCM context
+ * \param[out] tag               Authentication tag
+ *                               (tagLength bytes)
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCCMEnd(AESCCMContext& ctx, byte tag[])
+{
+  if (!AESCheckKey(ctx.keyGeneration)){
+    return 0;
+  }
+
+  if (!AESCCMStartText(ctx, 0) || ctx.textProcessed != ctx.textLength){
+    return 0;
+  }
+
+  if (!AESCCMMacPad(ctx)){
+    return 0;
+  }
+
+  // S0 = E(A0)
+  byte S0[16];
+  memcpy(S0, ctx.counterBlock, 16);
+  memset(&S0[16 - (ctx.counterBlock[0] + 1)], 0x00, ctx.counterBlock[0] + 1);
+
+  if (!AESBatchCommand(0x00, S0)){
+    return 0;
+  }
+  AESBatchEnd();
+
+  for (int i=0; i<ctx.tagLength; i++){
+    tag[i] = ctx.X[i]^S0[i];
+  }
+
+  return 1;
+}
+
+/** \brief Finishes a streaming AES_CCM decryption
+ *   and checks the authentication tag.
+ *
+ * \param[in,out] ctx            CCM context
+ * \param[in] tag                Expected authentication tag
+ *                               (tagLength bytes)
+ *
+ * \return 1 if the tag matches, otherwise 0.
+ */
+int ECCX08Class::AESCCMEndVerify(AESCCMContext& ctx, const byte tag[])
+{
+  byte tagComputed[16];
+  if (!AESCCMEnd(ctx, tagComputed)){
+    return 0;
+  }
+
+  uint8_t diff = 0;
+  for (int i=0; i<ctx.tagLength; i++){
+    diff |= (tag[i]^tagComputed[i]);
+  }
+
+  return (diff == 0);
+}
+
+/** \brief AES_CCM encryption function, see
+ *   NIST Special Publication 800-38C, using the current AES key.
+ *
+ * \param[in] nonce              Nonce
+ * \param[in] nonceLength        The length of nonce (7 to 13 bytes)
+ * \param[in] ad                 Associated data
+ * \param[in] adLength           The length of ad
+ * \param[in] pt                 Plaintext
+ * \param[out] ct                Ciphertext
+ * \param[in] ptLength           The length of pt
+ * \param[out] tag               Authentication tag
+ * \param[in] tagLength          The length of tag
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCCMEncrypt(const byte nonce[], int nonceLength, const byte ad[], size_t adLength, const byte pt[], byte ct[], size_t ptLength, byte tag[], int tagLength)
+{
+  AESCCMContext ctx;
+
+  if (!AESCCMBegin(ctx, nonce, nonceLength, adLength, ptLength, tagLength)){
+    return 0;
+  }
+
+  if (!AESCCMUpdateAAD(ctx, ad, adLength)){
+    return 0;
+  }
+
+  if (!AESCCMEncrypt(ctx, pt, ct, ptLength)){
+    return 0;
+  }
+
+  return AESCCMEnd(ctx, tag);
+}
+
+/** \brief AES_CCM decryption function, see
+ *   NIST Special Publication 800-38C, using the current AES key.
+ *   The plaintext is cleared if the tag does not match.
+ *
+ * \param[in] nonce              Nonce
+ * \param[in] nonceLength        The length of nonce (7 to 13 bytes)
+ * \param[in] ad                 Associated data
+ * \param[in] adLength           The length of ad
+ * \param[in] ct                 Ciphertext
+ * \param[out] pt                Plaintext
+ * \param[in] ctLength           The length of ct
+ * \param[in] tag                Authentication tag
+ * \param[in] tagLength          The length of tag
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESCCMDecrypt(const byte nonce[], int nonceLength, const byte ad[], size_t adLength, const byte ct[], byte pt[], size_t ctLength, const byte tag[], int tagLength)
+{
+  AESCCMContext ctx;
+
+  if (!AESCCMBegin(ctx, nonce, nonceLength, adLength, ctLength, tagLength)){
+    return 0;
+  }
+
+  if (!AESCCMUpdateAAD(ctx, ad, adLength)){
+    return 0;
+  }
+
+  if (!AESCCMDecrypt(ctx, ct, pt, ctLength) || !AESCCMEndVerify(ctx, tag)){
+    memset(pt, 0x00, ctLength);
+    return 0;
+  }
+
+  return 1;
+}
+
+/** \brief AES key wrap, see RFC 3394, using the current
+ *   AES key as key-encryption key.
+ *
+ * \param[in] key                Key to be wrapped
+ * \param[in] keyLength          The length of key, a multiple
+ *                               of 8, 16 to 64 bytes
+ * \param[out] wrapped           Wrapped key (keyLength + 8 bytes),
+ *                               may be the same buffer as key
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESKeyWrap(const byte key[], size_t keyLength, byte wrapped[])
+{
+  // the unwrap side takes up to 512 bit keys
+  if (keyLength < 16 || keyLength > 64 || keyLength % 8 != 0){
+    return 0;
+  }
+
+  memmove(&wrapped[8], key, keyLength);
+  memset(wrapped, 0xA6, 8);
+
+  return AESWrapBlocks(wrapped, keyLength / 8);
+}
+
+/** \brief AES key unwrap, see RFC 3394, using the current
+ *   AES key as key-encryption key.
+ *
+ * \param[in] wrapped            Wrapped key
+ * \param[in] wrappedLength      The length of wrapped, a multiple
+ *                               of 8, 24 to 72 bytes
+ * \param[out] key               Unwrapped key (wrappedLength - 8 bytes),
+ *                               may be the same buffer as wrapped
+ *
+ * \return 1 if the integrity check passed, otherwise 0.
+ */
+int ECCX08Class::AESKeyUnwrap(const byte wrapped[], size_t wrappedLength, byte key[])
+{
+  // up to 512 bit keys, bounds the buffer on the stack
+  if (wrappedLength < 24 || wrappedLength > 72 || wrappedLength % 8 != 0){
+    return 0;
+  }
+
+  byte data[wrappedLength];
+  memcpy(data, wrapped, wrappedLength);
+
+  uint8_t diff = 0;
+  if (!AESUnwrapBlocks(data, wrappedLength / 8 - 1)){
+    diff = 1;
+  }
+
+  for (int i=0; i<8; i++){
+    diff |= data[i]^0xA6;
+  }
+
+  if (diff == 0){
+    memcpy(key, &data[8], wrappedLength - 8);
+  }
+  memset(data, 0x00, sizeof(data));
+
+  return (diff == 0);
+}
+
+/** \brief AES key wrap with padding, see RFC 5649, using the
+ *   current AES key as key-encryption key.
+ *
+ * \param[in] key                Key to be wrapped
+ * \param[in] keyLength          The length of key (1 to 64 bytes)
+ * \param[out] wrapped           Wrapped key, keyLength rounded up
+ *                               to a multiple of 8, plus 8 bytes.
+ *                               May be the same buffer as key
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESKeyWrapPad(const byte key[], size_t keyLength, byte wrapped[])
+{
+  if (keyLength == 0 || keyLength > 64){
+    return 0;
+  }
+
+  size_t paddedLength = (keyLength + 7) / 8 * 8;
+
+  // AIV = A65959A6 | 32 bit big endian length
+  memmove(&wrapped[8], key, keyLength);
+  memset(&wrapped[8 + keyLength], 0x00, paddedLength - keyLength);
+  wrapped[0] = 0xA6;
+  wrapped[1] = 0x59;
+  wrapped[2] = 0x59;
+  wrapped[3] = 0xA6;
+  for (int i=0; i<4; i++){
+    wrapped[7-i] = ((uint32_t)keyLength >> (8*i)) & 0xFF;
+  }
+
+  if (paddedLength == 8){
+    // a single block is encrypted directly
+    return AESBlockEncrypt(wrapped);
+  }
+
+  return AESWrapBlocks(wrapped, paddedLength / 8);
+}
+
+/** \brief AES key unwrap with padding, see RFC 5649, using the
+ *   current AES key as key-encryption key.
+ *
+ * \param[in] wrapped            Wrapped key
+ * \param[in] wrappedLength      The length of wrapped, a multiple
+ *                               of 8, 16 to 72 bytes
+ * \param[out] key               Unwrapped key (up to
+ *                               wrappedLength - 8 bytes)
+ * \param[out] keyLength         The length of key
+ *
+ * \return 1 if the integrity check passed, otherwise 0.
+ */
+int ECCX08Class::AESKeyUnwrapPad(const byte wrapped[], size_t wrappedLength, byte key[], size_t* keyLength)
+{
+  if (wrappedLength < 16 || wrappedLength > 72 || wrappedLength % 8 != 0){
+    return 0;
+  }
+
+  byte data[wrappedLength];
+  memcpy(data, wrapped, wrappedLength);
+
+  uint8_t diff = 0;
+  if (wrappedLength == 16){
+    if (!AESBlockDecrypt(data)){
+      diff = 1;
+    }
+  } else if (!AESUnwrapBlocks(data, wrappedLength / 8 - 1)){
+    diff = 1;
+  }
+
+  diff |= data[0]^0xA6;
+  diff |= data[1]^0x59;
+  diff |= data[2]^0x59;
+  diff |= data[3]^0xA6;
+
+  uint32_t length = 0;
+  for (int i=4; i<8; i++){
+    length = (length << 8) | data[i];
+  }
+
+  size_t paddedLength = wrappedLength - 8;
+  if (length <= paddedLength - 8 || length > paddedLength){
+    diff = 1;
+  } else {
+    for (size_t i=length; i<paddedLength; i++){
+      diff |= data[8+i];
+    }
+  }
+
+  if (diff == 0){
+    memcpy(key, &data[8], length);
+    *keyLength = length;
+  }
+  memset(data, 0x00, sizeof(data));
+
+  return (diff == 0);
+}
+
+/** \brief Unwraps a key straight into TempKey, so it can be used
+ *   after AESSetKey(AES_KEY_TEMPKEY) without a slot. The key is
+ *   zero padded to 32 bytes and only kept in RAM while loading.
+ *
+ * \param[in] wrapped            Wrapped key, at most 32 bytes once
+ *                               unwrapped
+ * \param[in] wrappedLength      The length of wrapped
+ * \param[in] pad                true for RFC 5649, false for RFC 3394
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESKeyUnwrapToTempKey(const byte wrapped[], size_t wrappedLength, bool pad)
+{
+  if (wrappedLength > 40){
+    return 0;
+  }
+
+  byte key[40] = {0x00};
+  size_t keyLength = wrappedLength - 8;
+  int result;
+
+  if (pad){
+    result = AESKeyUnwrapPad(wrapped, wrappedLength, key, &keyLength);
+  } else {
+    result = AESKeyUnwrap(wrapped, wrappedLength, key);
+  }
+
+  if (result){
+    memset(&key[keyLength], 0x00, sizeof(key) - keyLength);
+    result = nonce(key);
+  }
+  memset(key, 0x00, sizeof(key));
+
+  return result;
+}
+
+/** \brief GCTR function, see
+ *   NIST Special Publication 800-38D
+ *   6.5
+ *
+ * \param[in,out] counterBlock    The initial counter block
+ *                                (16 bytes).
+ * \param[in] input               The input bit string
+ * \param[out] output             The output bit string
+ * \param[in] inputLength         The length of the input
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESGCTR(byte counterBlock[], byte input[], byte output[], const uint64_t inputLength)
+{
+  if(inputLength == 0){
+    return 1;
+  }
+  int remainder = inputLength % 16;
+  uint64_t n = inputLength / 16 + (remainder != 0);
+
+  // all counter blocks are encrypted in as few wake sessions as possible
+  uint64_t i;
+  for (i=0; i<n; i++){
+    byte temp[16];
+    memcpy(temp, counterBlock, 16);
+
+    if (!AESBatchCommand(0x00, temp)){
+      Serial.println("AESGCTR: failed to encrypt counter block.");
+      return 0;
+    }
+
+    int blockLength = (i == n-1 && remainder != 0) ? remainder : 16;
+    for (int j=0; j<blockLength; j++){
+      output[16*i+j] = input[16*i+j]^temp[j];
+    }
+
+    if (i == n-1){
+      break;
+    }
+
+    if (!AESIncrementBlock(counterBlock)){
+      Serial.println("AESGCTR: failed to increment counter block.");
+      AESBatchEnd();
+      return 0;
+    }
+  }
+  AESBatchEnd();
+
+  return 1;
+}
+
+/** \brief GHASH function, see
+ *   NIST Special Publication 800-38D
+ *   6.4, computed in software.
+ *
+ * \param[in] H                   The hash subkey H
+ *                                (16 bytes).
+ * \param[in] input               The input bit string
+ * \param[out] output             The output block
+ *                                (16 bytes)
+ * \param[in] inputLength         The length of the input
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESGHASH(byte H[], byte input[], byte output[], const uint64_t inputLength)
+{
+  if (inputLength % 16 != 0){
+    Serial.println("GHASH is only defined for multiples of 16 bytes.");
+    return 0;
+  }
+
+  GHASH_CTX ghash;
+  GHASHInit(&ghash, H);
+
+  memset(output, 0, 16);
+  for (uint64_t i=0; i< inputLength/16; i++){
+    for (int j=0; j<16; j++){
+      output[j] ^= input[16*i+j];
+    }
+    GHASHMultiply(&ghash, output);
+  }
+  return 1;
+}
+
+/** \brief Increments the right-most 32 bits of the block
+ * regarded as an integer mod 2^32
+ *
+ * \param[in,out] counterBlock  The block to be incremented
+ *                              (16 bytes). See
+ *                              NIST Special Publication 800-38D
+ *                              6.2
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESIncrementBlock(byte counterBlock[])
+{
+// Increment the big-endian counter value
+  int i;
   for (i = 0; i < 4; i++) {
     if (++(counterBlock[15 - i]) != 0) {
         break;
@@ -634,30 +1805,99 @@ int ECCX08Class::AESIncrementBlock(byte counterBlock[])
   return 1;
 }
 
-/** \brief AES encrypts a block using TempKey
+/** \brief AES encrypts a block using the current AES key
+ *
+ * \param[in,out] block         The block to be encrypted
+ *                              (16 bytes).
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESBlockEncrypt(byte block[])
+{
+  return AESBlockEncrypt(block, 1);
+}
+
+/** \brief AES encrypts consecutive blocks using the current AES key,
+ *   sharing wake sessions between the blocks.
+ *
+ * \param[in,out] blocks        The blocks to be encrypted
+ *                              (16 bytes each).
+ * \param[in] count             The number of blocks
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESBlockEncrypt(byte blocks[], size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    if (!AESBatchCommand(0x00, &blocks[16 * i])) {
+      return 0;
+    }
+  }
+  AESBatchEnd();
+
+  return 1;
+}
+
+/** \brief AES decrypts a block using the current AES key
+ *
+ * \param[in,out] block         The block to be decrypted
+ *                              (16 bytes).
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESBlockDecrypt(byte block[])
+{
+  return AESBlockDecrypt(block, 1);
+}
+
+/** \brief AES decrypts consecutive blocks using the current AES key,
+ *   sharing wake sessions between the blocks.
+ *
+ * \param[in,out] blocks        The blocks to be decrypted
+ *                              (16 bytes each).
+ * \param[in] count             The number of blocks
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESBlockDecrypt(byte blocks[], size_t count)
+{
+  for (size_t i = 0; i < count; i++) {
+    if (!AESBatchCommand(0x01, &blocks[16 * i])) {
+      return 0;
+    }
+  }
+  AESBatchEnd();
+
+  return 1;
+}
+
+/** \brief Generates counter mode keystream using the current AES key,
+ *   e.g. ahead of time while the application is idle.
  *
- * \param[in,out] block         The block to be encrypted
- *                              (16 bytes).
+ * \param[in,out] counterBlock  The first counter block
+ *                              (16 bytes), incremented past
+ *                              the last block used.
+ * \param[out] keystream        The keystream
+ *                              (16 bytes per block)
+ * \param[in] blocks            The number of blocks
  *
  * \return 1 on success, otherwise 0.
  */
-int ECCX08Class::AESBlockEncrypt(byte block[])
+int ECCX08Class::AESKeystream(byte counterBlock[], byte keystream[], size_t blocks)
 {
-  if (!wakeup()) {
-    return 0;
-  }
-  if (!sendCommand(0x51, 0x00, 0xFFFF, block, 16)) {
-    return 0;
-  }
+  for (size_t i = 0; i < blocks; i++) {
+    memcpy(&keystream[16 * i], counterBlock, 16);
 
-  delay(9);
+    if (!AESBatchCommand(0x00, &keystream[16 * i])) {
+      return 0;
+    }
 
-  if (!receiveResponse(block, 16)) {
-    return 0;
+    if (!AESIncrementBlock(counterBlock)) {
+      AESBatchEnd();
+      return 0;
+    }
   }
-
-  delay(1);
-  idle();
+  AESBatchEnd();
 
   return 1;
 }
@@ -696,6 +1936,13 @@ int ECCX08Class::AESBlockMultiplication(byte H[], byte block[])
 }
 
 /** \brief Generates AES GCM initialization vector.
+ *
+ * The IV is a 4 byte device ID followed by an 8 byte invocation
+ * field. Every increment of the monotonic counter reserves the 2^11
+ * invocation values counter * 2^11 to counter * 2^11 + 2^11 - 1,
+ * whatever the lease size. The first 2^bits of them are handed out
+ * (see AESSetIVLease) before the counter is incremented again, with
+ * the default lease of 0 bits only the first one is used.
  *
  * \param[out] IV               Initialization vector to be generated
  *                              (12 bytes). See
@@ -706,42 +1953,86 @@ int ECCX08Class::AESBlockMultiplication(byte H[], byte block[])
  */
 int ECCX08Class::AESGenIV(byte IV[])
 {
-  // The device ID is determined by the public key in slot 0
-  byte pubKey[64];
-  if (!generatePublicKey(0, pubKey)){
-    Serial.println("AESGenIV: failed to obtain device ID");
-    return 0;
-  }
-  // XOR the 64 public key bytes to get 4 bytes
-  byte deviceID[4] = {0x00};
-  for (int i=0; i<64; i++){
-    deviceID[i%4] ^= pubKey[i];
+  if (_ivRemaining == 0){
+    // The device ID is determined by the public key in slot 0
+    byte pubKey[64];
+    if (!generatePublicKey(0, pubKey)){
+      Serial.println("AESGenIV: failed to obtain device ID");
+      return 0;
+    }
+    // XOR the 64 public key bytes to get 4 bytes
+    memset(_ivDeviceID, 0x00, sizeof(_ivDeviceID));
+    for (int i=0; i<64; i++){
+      _ivDeviceID[i%4] ^= pubKey[i];
+    }
+
+    // Device only has two 4 byte counters
+    // instead of 8 byte counter.
+    // We increment one counter and read the other
+    // This should be enough for the lifetime of the device
+    byte counter0[4];
+    if (!incrementCounter(0, counter0)){
+      Serial.println("AESGenIV: failed to increment counter");
+      return 0;
+    }
+    byte counter1[4];
+    if (!readCounter(1, counter1)){
+      Serial.println("AESGenIV: failed to read counter");
+      return 0;
+    }
+
+    // chip counter is little endian
+    uint64_t counter = 0;
+    for (int i=3; i>=0; i--){
+      counter = (counter << 8) | counter1[i];
+    }
+    for (int i=3; i>=0; i--){
+      counter = (counter << 8) | counter0[i];
+    }
+
+    // Every counter value owns the block [counter * 2^11,
+    // (counter + 1) * 2^11) whatever the lease size, the lease only
+    // limits how much of the block is used. Blocks of different
+    // counter values never overlap, so no IV repeats even if the
+    // lease size changes between resets. The counters are at most
+    // 21 bits wide, the shifted value fits into 64 bits.
+    _ivNext = counter << 11;
+    _ivRemaining = 1ul << _ivLeaseBits;
   }
+
   // First 4 bytes of IV are device ID
   for (int i=0; i<4; i++){
-    IV[i] = deviceID[i];
+    IV[i] = _ivDeviceID[i];
   }
 
-  // Device only has two 4 byte counters
-  // instead of 8 byte counter.
-  // We increment one counter and read the other
-  // This should be enough for the lifetime of the device
-  byte counter0[4];
-  if (!incrementCounter(0, counter0)){
-    Serial.println("AESGenIV: failed to increment counter");
-    return 0;
+  // Last 8 bytes of IV are the big endian invocation field
+  for (int i=0; i<8; i++){
+    IV[11-i] = (_ivNext >> (8*i)) & 0xFF;
   }
-  byte counter1[4];
-  if (!readCounter(1, counter1)){
-    Serial.println("AESGenIV: failed to read counter");
+  _ivNext++;
+  _ivRemaining--;
+
+  return 1;
+}
+
+/** \brief Sets how many IVs AESGenIV takes from a single
+ *   increment of the monotonic counter.
+ *
+ * \param[in] bits              Lease size as a power of 2
+ *                              (0 to 11), 0 increments the
+ *                              counter for every IV.
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08Class::AESSetIVLease(int bits)
+{
+  if (bits < 0 || bits > 11){
     return 0;
   }
-  // Last 8 bytes of IV are counter
-  for (int i=0; i<4; i++){
-    // chip counter is little endian
-    IV[11-i] = counter0[i];
-    IV[7-i] = counter1[i];
-  }
+
+  _ivLeaseBits = bits;
+  // drop the current lease, it was sized for the old value
+  _ivRemaining = 0;
 
   return 1;
 }
@@ -1018,6 +2309,60 @@ int ECCX08Class::nonce(const byte data[])
   return challenge(data);
 }
 
+/** \brief Reports what TempKey currently holds.
+ *
+ * Commands that overwrite or invalidate TempKey (SHA, HMAC,
+ * Random, Sign, Verify, Nonce...) reset the source, so a key
+ * is never silently reused after it was clobbered.
+ *
+ * \return One of the TEMPKEY_SOURCE_* values.
+ */
+int ECCX08Class::tempKeySource()
+{
+  return _tempKeySource;
+}
+
+/** \brief Private key slot the TempKey content was derived from
+ *   (ECDH, or KDF on an ECDH result), -1 if none.
+ */
+int ECCX08Class::tempKeySlot()
+{
+  return _tempKeySlot;
+}
+
+/** \brief Identifies the current TempKey content, the value
+ *   changes whenever TempKey is loaded or invalidated.
+ */
+uint32_t ECCX08Class::tempKeyGeneration()
+{
+  return _tempKeyGeneration;
+}
+
+/** \brief Checks whether TempKey still holds what was loaded
+ *   when generation was taken, so the Nonce/ECDH that loaded
+ *   it can be skipped.
+ *
+ * \param[in] generation         Value of tempKeyGeneration()
+ *                               right after loading TempKey
+ *
+ * \return 1 if TempKey is unchanged, otherwise 0.
+ */
+int ECCX08Class::tempKeyValid(uint32_t generation)
+{
+  return (_tempKeySource != TEMPKEY_SOURCE_NONE && _tempKeyGeneration == generation);
+}
+
+/** \brief Tells the library that TempKey holds a key loaded
+ *   without nonce(), ecdh() or kdf(), so AES can use it.
+ *
+ * \param[in] source             One of the TEMPKEY_SOURCE_* values,
+ *                               TEMPKEY_SOURCE_NONE invalidates
+ */
+void ECCX08Class::tempKeyMarkLoaded(uint8_t source)
+{
+  tempKeyLoaded(source, -1);
+}
+
 int ECCX08Class::wakeup()
 {
   _wire->setClock(_wakeupFrequency);
@@ -1039,6 +2384,9 @@ int ECCX08Class::wakeup()
 
 int ECCX08Class::sleep()
 {
+  // sleep clears all volatile state
+  tempKeyInvalidate();
+
   _wire->beginTransmission(_address);
   _wire->write(0x01);
 
@@ -1115,6 +2463,8 @@ int ECCX08Class::challenge(const byte message[])
     return 0;
   }
 
+  tempKeyLoaded(TEMPKEY_SOURCE_NONCE, -1);
+
   return 1;
 }
 
@@ -1275,8 +2625,333 @@ int ECCX08Class::addressForSlotOffset(int slot, int offset)
   return (slot << 3) | (block << 8) | (offset);
 }
 
+int ECCX08Class::AESGCMStart(AESGCMContext& ctx, const byte IV[])
+{
+  // H is only used by the software GHASH
+  byte H[16] = {0x00};
+  if (!AESGCMBlock(ctx, H)){
+    return 0;
+  }
+  AESBatchEnd();
+  GHASHInit(&ctx.ghash, H);
+  memset(H, 0x00, sizeof(H));
+
+  memcpy(ctx.J0, IV, 12);
+  ctx.J0[15] = 0x01;
+
+  memcpy(ctx.counterBlock, ctx.J0, 16);
+  if (!AESIncrementBlock(ctx.counterBlock)){
+    return 0;
+  }
+
+  ctx.keystreamUsed = 16;
+
+  return 1;
+}
+
+int ECCX08Class::AESGCMBlock(AESGCMContext& ctx, byte block[])
+{
+  if (ctx.softwareKey != NULL){
+    AES128Encrypt(ctx.softwareKey, block, block);
+    return 1;
+  }
+
+  return AESBatchCommand(0x00, block);
+}
+
+int ECCX08Class::AESGCMHash(AESGCMContext& ctx, const byte data[], size_t length)
+{
+  // S is the running GHASH value, data is xored into it in place
+  // and multiplied by H whenever a block is complete.
+  while (length--){
+    ctx.S[ctx.hashUsed++] ^= *data++;
+
+    if (ctx.hashUsed == 16){
+      GHASHMultiply(&ctx.ghash, ctx.S);
+      ctx.hashUsed = 0;
+    }
+  }
+
+  return 1;
+}
+
+int ECCX08Class::AESGCMHashPad(AESGCMContext& ctx)
+{
+  // zero padding to a full block leaves S unchanged
+  if (ctx.hashUsed != 0){
+    GHASHMultiply(&ctx.ghash, ctx.S);
+    ctx.hashUsed = 0;
+  }
+
+  return 1;
+}
+
+int ECCX08Class::AESGCMCounter(AESGCMContext& ctx, const byte input[], byte output[], size_t length)
+{
+  while (length--){
+    if (ctx.keystreamUsed == 16 && ctx.precomputedUsed < ctx.precomputedLength){
+      *output++ = *input++ ^ ctx.precomputed[ctx.precomputedUsed++];
+      continue;
+    }
+
+    if (ctx.keystreamUsed == 16){
+      memcpy(ctx.keystream, ctx.counterBlock, 16);
+
+      if (!AESGCMBlock(ctx, ctx.keystream)){
+        return 0;
+      }
+
+      if (!AESIncrementBlock(ctx.counterBlock)){
+        AESBatchEnd();
+        return 0;
+      }
+      ctx.keystreamUsed = 0;
+    }
+
+    *output++ = *input++ ^ ctx.keystream[ctx.keystreamUsed++];
+  }
+  AESBatchEnd();
+
+  return 1;
+}
+
+int ECCX08Class::AESCCMStartText(AESCCMContext& ctx, size_t length)
+{
+  if (!ctx.aadDone){
+    if (ctx.adProcessed != ctx.adLength){
+      return 0;
+    }
+
+    if (!AESCCMMacPad(ctx)){
+      return 0;
+    }
+    ctx.aadDone = true;
+  }
+
+  if (length > ctx.textLength - ctx.textProcessed){
+    return 0;
+  }
+
+  return 1;
+}
+
+int ECCX08Class::AESCCMMac(AESCCMContext& ctx, const byte data[], size_t length)
+{
+  // CBC-MAC, X is encrypted whenever a block is complete
+  while (length--){
+    ctx.X[ctx.macUsed++] ^= *data++;
+
+    if (ctx.macUsed == 16){
+      if (!AESBatchCommand(0x00, ctx.X)){
+        return 0;
+      }
+      ctx.macUsed = 0;
+    }
+  }
+
+  return 1;
+}
+
+int ECCX08Class::AESCCMMacPad(AESCCMContext& ctx)
+{
+  // zero padding to a full block leaves X unchanged
+  if (ctx.macUsed != 0){
+    if (!AESBatchCommand(0x00, ctx.X)){
+      return 0;
+    }
+    ctx.macUsed = 0;
+  }
+
+  return 1;
+}
+
+int ECCX08Class::AESCCMCounter(AESCCMContext& ctx, const byte input[], byte output[], size_t length)
+{
+  while (length--){
+    if (ctx.keystreamUsed == 16){
+      // A_i, the counter starts at 1
+      if (!AESIncrementBlock(ctx.counterBlock)){
+        return 0;
+      }
+      memcpy(ctx.keystream, ctx.counterBlock, 16);
+
+      if (!AESBatchCommand(0x00, ctx.keystream)){
+        return 0;
+      }
+      ctx.keystreamUsed = 0;
+    }
+
+    *output++ = *input++ ^ ctx.keystream[ctx.keystreamUsed++];
+  }
+
+  return 1;
+}
+
+int ECCX08Class::AESWrapBlocks(byte data[], size_t n)
+{
+  // data = A | R[1] ... R[n], wrapped in place
+  byte B[16];
+  uint64_t t = 0;
+
+  for (int j=0; j<6; j++){
+    for (size_t i=1; i<=n; i++){
+      memcpy(B, data, 8);
+      memcpy(&B[8], &data[8*i], 8);
+
+      if (!AESBatchCommand(0x00, B)){
+        memset(B, 0x00, sizeof(B));
+        return 0;
+      }
+
+      t++;
+      for (int k=0; k<8; k++){
+        data[k] = B[k]^((t >> (56-8*k)) & 0xFF);
+      }
+      memcpy(&data[8*i], &B[8], 8);
+    }
+  }
+  AESBatchEnd();
+  memset(B, 0x00, sizeof(B));
+
+  return 1;
+}
+
+int ECCX08Class::AESUnwrapBlocks(byte data[], size_t n)
+{
+  // data = A | R[1] ... R[n], unwrapped in place
+  byte B[16];
+  uint64_t t = 6*(uint64_t)n;
+
+  for (int j=5; j>=0; j--){
+    for (size_t i=n; i>=1; i--){
+      for (int k=0; k<8; k++){
+        B[k] = data[k]^((t >> (56-8*k)) & 0xFF);
+      }
+      memcpy(&B[8], &data[8*i], 8);
+      t--;
+
+      if (!AESBatchCommand(0x01, B)){
+        memset(B, 0x00, sizeof(B));
+        return 0;
+      }
+
+      memcpy(data, B, 8);
+      memcpy(&data[8*i], &B[8], 8);
+    }
+  }
+  AESBatchEnd();
+  memset(B, 0x00, sizeof(B));
+
+  return 1;
+}
+
+int ECCX08Class::AESCheckKey(uint32_t keyGeneration)
+{
+  // the AES key changed since the context was started
+  if (keyGeneration != _aesKeyGeneration) {
+    Serial.println("AESCheckKey: AES key changed during operation.");
+    return 0;
+  }
+
+  return 1;
+}
+
+int ECCX08Class::AESBatchCommand(byte mode, byte block[])
+{
+  if (_aesKeyId == AES_KEY_TEMPKEY && _tempKeySource == TEMPKEY_SOURCE_NONE) {
+    Serial.println("AESBatchCommand: TempKey holds no valid key, load it with nonce() or call tempKeyMarkLoaded().");
+    AESBatchEnd();
+    return 0;
+  }
+
+  // The watchdog puts the chip to sleep about 1.3 s after wakeup,
+  // so long batches are split into several wake sessions. At most
+  // 16 blocks of up to 27 ms each, and fewer if the host is slow
+  // between blocks.
+  if (_aesBatchBlocks == _aesBatchMax ||
+      (_aesBatchBlocks > 0 && millis() - _aesBatchStart > 500)) {
+    AESBatchEnd();
+  }
+
+  if (_aesBatchBlocks == 0) {
+    if (!wakeup()) {
+      return 0;
+    }
+    _aesBatchStart = millis();
+  }
+  _aesBatchBlocks++;
+
+  if (!sendCommand(0x51, mode | (_aesKeyBlock << 6), _aesKeyId, block, 16)) {
+    AESBatchEnd();
+    return 0;
+  }
+
+  if (!pollResponse(block, 16, 27)) {
+    AESBatchEnd();
+    return 0;
+  }
+
+  return 1;
+}
+
+void ECCX08Class::AESBatchEnd()
+{
+  if (_aesBatchBlocks == 0) {
+    return;
+  }
+  _aesBatchBlocks = 0;
+
+  delay(1);
+  idle();
+}
+
+void ECCX08Class::tempKeyLoaded(uint8_t source, int slot)
+{
+  _tempKeySource = source;
+  _tempKeySlot = slot;
+  _tempKeyGeneration++;
+
+  if (_aesKeyId == AES_KEY_TEMPKEY) {
+    _aesKeyGeneration++;
+  }
+}
+
+void ECCX08Class::tempKeyInvalidate()
+{
+  if (_tempKeySource == TEMPKEY_SOURCE_NONE) {
+    return;
+  }
+
+  tempKeyLoaded(TEMPKEY_SOURCE_NONE, -1);
+}
+
+void ECCX08Class::tempKeyCommand(uint8_t opcode, uint8_t param1)
+{
+  switch (opcode) {
+    case 0x16: // Nonce
+    case 0x1b: // Random
+    case 0x41: // Sign
+    case 0x43: // ECDH
+    case 0x45: // Verify
+    case 0x47: // SHA, HMAC
+    case 0x56: // KDF
+      // loaders mark TempKey valid again once they succeeded
+      tempKeyInvalidate();
+      break;
+
+    case 0x40: // GenKey
+      // only the digest modes write TempKey
+      if (param1 & 0x18) {
+        tempKeyInvalidate();
+      }
+      break;
+  }
+}
+
 int ECCX08Class::sendCommand(uint8_t opcode, uint8_t param1, uint16_t param2, const byte data[], size_t dataLength)
 {
+  tempKeyCommand(opcode, param1);
+
   int commandLength = 8 + dataLength; // 1 for type, 1 for length, 1 for opcode, 1 for param1, 2 for param2, 2 for CRC
   byte command[commandLength]; 
   
@@ -1303,10 +2978,34 @@ int ECCX08Class::receiveResponse(void* response, size_t length)
 {
   int retries = 20;
   size_t responseSize = length + 3; // 1 for length header, 2 for CRC
-  byte responseBuffer[responseSize];
 
   while (_wire->requestFrom((uint8_t)_address, (size_t)responseSize, (bool)true) != responseSize && retries--);
 
+  return readResponse(response, length);
+}
+
+int ECCX08Class::pollResponse(void* response, size_t length, unsigned long timeout)
+{
+  size_t responseSize = length + 3; // 1 for length header, 2 for CRC
+  unsigned long start = millis();
+
+  // the chip NACKs its address until the command completed
+  while (_wire->requestFrom((uint8_t)_address, (size_t)responseSize, (bool)true) != responseSize) {
+    if ((millis() - start) > timeout) {
+      return 0;
+    }
+
+    delayMicroseconds(100);
+  }
+
+  return readResponse(response, length);
+}
+
+int ECCX08Class::readResponse(void* response, size_t length)
+{
+  size_t responseSize = length + 3; // 1 for length header, 2 for CRC
+  byte responseBuffer[responseSize];
+
   responseBuffer[0] = _wire->read();
 
   // make sure length matches
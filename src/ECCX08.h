@@ -23,6 +23,57 @@
 #include <Arduino.h>
 #include <Wire.h>
 
+extern "C" {
+  #include "utility/aes128.h"
+  #include "utility/ghash.h"
+}
+
+#ifndef ECCX08_AES_STREAM_BUFFER_SIZE
+#define ECCX08_AES_STREAM_BUFFER_SIZE 128
+#endif
+
+typedef size_t (*AESReadCallback)(void* arg, uint64_t offset, byte buffer[], size_t length);
+
+struct AESGCMContext {
+  GHASH_CTX ghash;
+  byte J0[16];
+  byte counterBlock[16];
+  byte S[16];
+  byte keystream[16];
+  uint8_t keystreamUsed;
+  const byte* precomputed;
+  size_t precomputedLength;
+  size_t precomputedUsed;
+  uint8_t hashUsed;
+  bool aadDone;
+  uint64_t adLength;
+  uint64_t textLength;
+  uint32_t keyGeneration;
+  const AES128_CTX* softwareKey;
+};
+
+struct AESCMACContext {
+  byte X[16];
+  byte buffer[16];
+  uint8_t bufferLength;
+  uint32_t keyGeneration;
+};
+
+struct AESCCMContext {
+  byte X[16];
+  byte counterBlock[16];
+  byte keystream[16];
+  uint8_t keystreamUsed;
+  uint8_t macUsed;
+  uint8_t tagLength;
+  bool aadDone;
+  uint64_t adLength;
+  uint64_t adProcessed;
+  uint64_t textLength;
+  uint64_t textProcessed;
+  uint32_t keyGeneration;
+};
+
 class ECCX08Class
 {
 public:
@@ -42,6 +93,7 @@ public:
 
   int generatePrivateKey(int slot, byte publicKey[]);
   int generatePublicKey(int slot, byte publicKey[]);
+  uint8_t privateKeyGeneration(int slot);
 
   int ecdsaVerify(const byte message[], const byte signature[], const byte pubkey[]);
   int ecSign(int slot, const byte message[], byte signature[]);
@@ -55,17 +107,67 @@ public:
   #define ECDH_MODE_TEMPKEY               ((uint8_t)0x08)         //!< ECDH mode: write to TempKey
   #define ECDH_MODE_OUTPUT                ((uint8_t)0x0c)         //!< ECDH mode: write to buffer
 
+  int kdf(byte mode, uint16_t keyId, uint32_t details, const byte message[], int length, byte output[]);
+  #define KDF_MODE_SOURCE_TEMPKEY         ((uint8_t)0x00)         //!< KDF mode: source key in TempKey
+  #define KDF_MODE_TARGET_TEMPKEY         ((uint8_t)0x00)         //!< KDF mode: write to TempKey
+  #define KDF_MODE_TARGET_OUTPUT          ((uint8_t)0x10)         //!< KDF mode: write to buffer
+  #define KDF_MODE_ALG_HKDF               ((uint8_t)0x40)         //!< KDF mode: HKDF (HMAC-SHA256)
+  #define KDF_DETAILS_HKDF_MSG_LOC_INPUT  ((uint32_t)0x00000002)  //!< KDF details: HKDF message in input
+
+  int AESBeginSession(int slot, const byte pubKeyXandY[], const byte info[] = NULL, int infoLength = 0);
+
+  int AESDeriveSessionKey(int slot, const byte pubKeyXandY[], const byte info[], int infoLength, AES128_CTX& key);
+
+  int AESSetKey(uint16_t keyId, int keyBlock = 0);
+  #define AES_KEY_TEMPKEY                 ((uint16_t)0xFFFF)      //!< AES key id: use TempKey
+
   int AESEncrypt(byte IV[], byte ad[], byte pt[], byte ct[], byte tag[], const uint64_t adLength, const uint64_t ptLength);
   int AESDecrypt(byte IV[], byte ad[], byte pt[], byte ct[], byte tag[], const uint64_t adLength, const uint64_t ctLength);
+  int AESDecrypt(const byte IV[], const byte ad[], const uint64_t adLength, AESReadCallback read, void* arg, const uint64_t ctLength, const byte tag[], Print& out);
+
+  int AESGCMBegin(AESGCMContext& ctx, const byte IV[]);
+  int AESGCMBegin(AESGCMContext& ctx, const byte IV[], const AES128_CTX& key);
+  int AESGCMUpdateAAD(AESGCMContext& ctx, const byte ad[], size_t length);
+  int AESGCMEncrypt(AESGCMContext& ctx, const byte pt[], byte ct[], size_t length);
+  int AESGCMDecrypt(AESGCMContext& ctx, const byte ct[], byte pt[], size_t length);
+  int AESGCMEnd(AESGCMContext& ctx, byte tag[]);
+  int AESGCMEndVerify(AESGCMContext& ctx, const byte tag[]);
+  int AESGCMPrecompute(AESGCMContext& ctx, byte buffer[], size_t length);
+
+  int AESCMACBegin(AESCMACContext& ctx);
+  int AESCMACUpdate(AESCMACContext& ctx, const byte data[], size_t length);
+  int AESCMACEnd(AESCMACContext& ctx, byte mac[]);
+  int AESCMACEndVerify(AESCMACContext& ctx, const byte mac[], int macLength);
+
+  int AESCCMEncrypt(const byte nonce[], int nonceLength, const byte ad[], size_t adLength, const byte pt[], byte ct[], size_t ptLength, byte tag[], int tagLength);
+  int AESCCMDecrypt(const byte nonce[], int nonceLength, const byte ad[], size_t adLength, const byte ct[], byte pt[], size_t ctLength, const byte tag[], int tagLength);
+
+  int AESCCMBegin(AESCCMContext& ctx, const byte nonce[], int nonceLength, uint64_t adLength, uint64_t textLength, int tagLength);
+  int AESCCMUpdateAAD(AESCCMContext& ctx, const byte ad[], size_t length);
+  int AESCCMEncrypt(AESCCMContext& ctx, const byte pt[], byte ct[], size_t length);
+  int AESCCMDecrypt(AESCCMContext& ctx, const byte ct[], byte pt[], size_t length);
+  int AESCCMEnd(AESCCMContext& ctx, byte tag[]);
+  int AESCCMEndVerify(AESCCMContext& ctx, const byte tag[]);
+
+  int AESKeyWrap(const byte key[], size_t keyLength, byte wrapped[]);
+  int AESKeyUnwrap(const byte wrapped[], size_t wrappedLength, byte key[]);
+  int AESKeyWrapPad(const byte key[], size_t keyLength, byte wrapped[]);
+  int AESKeyUnwrapPad(const byte wrapped[], size_t wrappedLength, byte key[], size_t* keyLength);
+  int AESKeyUnwrapToTempKey(const byte wrapped[], size_t wrappedLength, bool pad = false);
 
   int AESGCTR(byte counterBlock[], byte input[], byte output[], const uint64_t inputLength);
   int AESGHASH(byte counterBlock[], byte input[], byte output[], const uint64_t inputLength);
 
   int AESIncrementBlock(byte counterBlock[]);
   int AESBlockEncrypt(byte block[]);
+  int AESBlockEncrypt(byte blocks[], size_t count);
+  int AESBlockDecrypt(byte block[]);
+  int AESBlockDecrypt(byte blocks[], size_t count);
+  int AESKeystream(byte counterBlock[], byte keystream[], size_t blocks);
   int AESBlockMultiplication(byte H[], byte block[]);
 
   int AESGenIV(byte IV[]);
+  int AESSetIVLease(int bits);
   int incrementCounter(int slot, byte counter[]);
   int readCounter(int slot, byte counter[]);
 
@@ -84,6 +186,20 @@ public:
 
   int nonce(const byte data[]);
 
+  #define TEMPKEY_SOURCE_NONE             ((uint8_t)0x00)         //!< TempKey source: invalid
+  #define TEMPKEY_SOURCE_NONCE            ((uint8_t)0x01)         //!< TempKey source: Nonce (pass-through)
+  #define TEMPKEY_SOURCE_ECDH             ((uint8_t)0x02)         //!< TempKey source: ECDH
+  #define TEMPKEY_SOURCE_KDF              ((uint8_t)0x03)         //!< TempKey source: KDF
+  // AES with AES_KEY_TEMPKEY fails unless TempKey was loaded through
+  // nonce(), ecdh() or kdf() since begin() or the last command that
+  // cleared it. Call tempKeyMarkLoaded() if TempKey was loaded some
+  // other way.
+  int tempKeySource();
+  int tempKeySlot();
+  uint32_t tempKeyGeneration();
+  int tempKeyValid(uint32_t generation);
+  void tempKeyMarkLoaded(uint8_t source = TEMPKEY_SOURCE_NONCE);
+
 private:
   int wakeup();
   int sleep();
@@ -100,16 +216,55 @@ private:
 
   int addressForSlotOffset(int slot, int offset);
 
+  void tempKeyLoaded(uint8_t source, int slot);
+  void tempKeyInvalidate();
+  void tempKeyCommand(uint8_t opcode, uint8_t param1);
+
+  int AESGCMStart(AESGCMContext& ctx, const byte IV[]);
+  int AESGCMBlock(AESGCMContext& ctx, byte block[]);
+  int AESGCMHash(AESGCMContext& ctx, const byte data[], size_t length);
+  int AESGCMHashPad(AESGCMContext& ctx);
+  int AESGCMCounter(AESGCMContext& ctx, const byte input[], byte output[], size_t length);
+  int AESCCMStartText(AESCCMContext& ctx, size_t length);
+  int AESCCMMac(AESCCMContext& ctx, const byte data[], size_t length);
+  int AESCCMMacPad(AESCCMContext& ctx);
+  int AESCCMCounter(AESCCMContext& ctx, const byte input[], byte output[], size_t length);
+  int AESWrapBlocks(byte data[], size_t n);
+  int AESUnwrapBlocks(byte data[], size_t n);
+  int AESCheckKey(uint32_t keyGeneration);
+  int AESBatchCommand(byte mode, byte block[]);
+  void AESBatchEnd();
+
   int sendCommand(uint8_t opcode, uint8_t param1, uint16_t param2, const byte data[] = NULL, size_t dataLength = 0);
   int receiveResponse(void* response, size_t length);
+  int pollResponse(void* response, size_t length, unsigned long timeout);
+  int readResponse(void* response, size_t length);
   uint16_t crc16(const byte data[], size_t length);
 
 private:
   TwoWire* _wire;
   uint8_t _address;
 
+  uint8_t _privateKeyGeneration[16];
+
+  uint8_t _tempKeySource;
+  int8_t _tempKeySlot;
+  uint32_t _tempKeyGeneration;
+
+  uint16_t _aesKeyId;
+  uint8_t _aesKeyBlock;
+  uint32_t _aesKeyGeneration;
+  int _aesBatchBlocks;
+  unsigned long _aesBatchStart;
+
+  int _ivLeaseBits;
+  uint32_t _ivRemaining;
+  uint64_t _ivNext;
+  byte _ivDeviceID[4];
+
   static const uint32_t _wakeupFrequency;
   static const uint32_t _normalFrequency;
+  static const int _aesBatchMax;
 };
 
 extern ECCX08Class ECCX08;
@@ -410,4 +410,471 @@ int ASN1UtilsClass::appendEcdsaWithSHA256(byte out[])
   return 12;
 }
 
+int ASN1UtilsClass::appendVersion(int version, ASN1Writer& out)
+{
+  byte* p = out.reserve(versionLength());
+
+  if (p == NULL) {
+    return 0;
+  }
+
+  appendVersion(version, p);
+
+  return 1;
+}
+
+int ASN1UtilsClass::appendIssuerOrSubject(const String& countryName,
+                                           const String& stateProvinceName,
+                                           const String& localityName,
+                                           const String& organizationName,
+                                           const String& organizationalUnitName,
+                                           const String& commonName,
+                                           ASN1Writer& out)
+{
+  // unlike the byte[] version this includes the sequence header
+  out.begin(ASN1_SEQUENCE);
+
+  if (countryName.length() > 0) {
+    appendName(countryName, 0x06, out);
+  }
+
+  if (stateProvinceName.length() > 0) {
+    appendName(stateProvinceName, 0x08, out);
+  }
+
+  if (localityName.length() > 0) {
+    appendName(localityName, 0x07, out);
+  }
+
+  if (organizationName.length() > 0) {
+    appendName(organizationName, 0x0a, out);
+  }
+
+  if (organizationalUnitName.length() > 0) {
+    appendName(organizationalUnitName, 0x0b, out);
+  }
+
+  if (commonName.length() > 0) {
+    appendName(commonName, 0x03, out);
+  }
+
+  return out.end();
+}
+
+int ASN1UtilsClass::appendPublicKey(const byte publicKey[], ASN1Writer& out)
+{
+  byte* p = out.reserve(publicKeyLength());
+
+  if (p == NULL) {
+    return 0;
+  }
+
+  appendPublicKey(publicKey, p);
+
+  return 1;
+}
+
+int ASN1UtilsClass::appendSignature(const byte signature[], ASN1Writer& out)
+{
+  byte* p = out.reserve(signatureLength(signature));
+
+  if (p == NULL) {
+    return 0;
+  }
+
+  appendSignature(signature, p);
+
+  return 1;
+}
+
+int ASN1UtilsClass::appendSerialNumber(const byte serialNumber[], int length, ASN1Writer& out)
+{
+  byte* p = out.reserve(serialNumberLength(serialNumber, length));
+
+  if (p == NULL) {
+    return 0;
+  }
+
+  appendSerialNumber(serialNumber, length, p);
+
+  return 1;
+}
+
+int ASN1UtilsClass::appendName(const String& name, int type, ASN1Writer& out)
+{
+  const byte oid[] = { 0x55, 0x04, (byte)type };
+
+  out.begin(ASN1_SET);
+  out.begin(ASN1_SEQUENCE);
+  out.append(ASN1_OBJECT_IDENTIFIER, oid, sizeof(oid));
+  out.append(ASN1_PRINTABLE_STRING, (const byte*)name.c_str(), name.length());
+  out.end();
+
+  return out.end();
+}
+
+int ASN1UtilsClass::appendDate(int year, int month, int day, int hour, int minute, int second, ASN1Writer& out)
+{
+  byte* p = out.reserve((year > 2049) ? 17 : 15);
+
+  if (p == NULL) {
+    return 0;
+  }
+
+  appendDate(year, month, day, hour, minute, second, p);
+
+  return 1;
+}
+
+int ASN1UtilsClass::appendEcdsaWithSHA256(ASN1Writer& out)
+{
+  byte* p = out.reserve(12);
+
+  if (p == NULL) {
+    return 0;
+  }
+
+  appendEcdsaWithSHA256(p);
+
+  return 1;
+}
+
+int ASN1UtilsClass::parsePublicKey(const ASN1Element& subjectPublicKeyInfo, byte publicKey[])
+{
+  static const byte EC_PUBLIC_KEY[] = { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02, 0x01 };
+  static const byte PRIME_256_V1[] = { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07 };
+
+  ASN1Reader spki(subjectPublicKeyInfo);
+  ASN1Element algorithm;
+  ASN1Element key;
+
+  if (subjectPublicKeyInfo.tag != ASN1_SEQUENCE ||
+      !spki.next(ASN1_SEQUENCE, algorithm) ||
+      !spki.next(ASN1_BIT_STRING, key)) {
+    return 0;
+  }
+
+  ASN1Reader algorithmReader(algorithm);
+  ASN1Element oid;
+  ASN1Element curve;
+
+  if (!algorithmReader.next(ASN1_OBJECT_IDENTIFIER, oid) ||
+      !oidEquals(oid, EC_PUBLIC_KEY, sizeof(EC_PUBLIC_KEY)) ||
+      !algorithmReader.next(ASN1_OBJECT_IDENTIFIER, curve) ||
+      !oidEquals(curve, PRIME_256_V1, sizeof(PRIME_256_V1))) {
+    return 0;
+  }
+
+  // no unused bits, uncompressed point
+  if (key.length != 66 || key.value[0] != 0x00 || key.value[1] != 0x04) {
+    return 0;
+  }
+
+  memcpy(publicKey, &key.value[2], 64);
+
+  return 1;
+}
+
+int ASN1UtilsClass::parseSignature(const ASN1Element& signature, byte rs[])
+{
+  ASN1Element sequence;
+
+  // BIT STRING { SEQUENCE { INTEGER r, INTEGER s } }
+  if (signature.tag != ASN1_BIT_STRING || signature.length < 1 || signature.value[0] != 0x00) {
+    return 0;
+  }
+
+  ASN1Reader bitString(&signature.value[1], signature.length - 1);
+
+  if (!bitString.next(ASN1_SEQUENCE, sequence) || !bitString.atEnd()) {
+    return 0;
+  }
+
+  ASN1Reader integers(sequence);
+
+  for (int i = 0; i < 2; i++) {
+    ASN1Element integer;
+
+    if (!integers.next(ASN1_INTEGER, integer) || integer.length < 1) {
+      return 0;
+    }
+
+    const byte* value = integer.value;
+    int length = integer.length;
+
+    while (length > 1 && *value == 0x00) {
+      value++;
+      length--;
+    }
+
+    if (length > 32) {
+      return 0;
+    }
+
+    memset(&rs[32 * i], 0x00, 32 - length);
+    memcpy(&rs[32 * i + 32 - length], value, length);
+  }
+
+  return 1;
+}
+
+bool ASN1UtilsClass::oidEquals(const ASN1Element& oid, const byte value[], int length)
+{
+  return (oid.tag == ASN1_OBJECT_IDENTIFIER && oid.length == length && memcmp(oid.value, value, length) == 0);
+}
+
+ASN1Reader::ASN1Reader(const byte data[], int length) :
+  _data(data),
+  _length(length),
+  _offset(0),
+  _error(false)
+{
+}
+
+ASN1Reader::ASN1Reader(const ASN1Element& element) :
+  _data(element.value),
+  _length(element.length),
+  _offset(0),
+  _error(false)
+{
+}
+
+int ASN1Reader::next(ASN1Element& element)
+{
+  if (_error || atEnd()) {
+    return 0;
+  }
+
+  const byte* header = &_data[_offset];
+  int remaining = _length - _offset;
+
+  // high tag numbers are not used in X.509
+  if (remaining < 2 || (header[0] & 0x1f) == 0x1f) {
+    _error = true;
+    return 0;
+  }
+
+  uint32_t length = header[1];
+  int headerLength = 2;
+
+  if (length & 0x80) {
+    int count = length & 0x7f;
+
+    // no indefinite form in DER, the buffer is int sized so at most
+    // two length bytes (and int is 16 bits on AVR)
+    if (count == 0 || count > 2 || remaining < 2 + count) {
+      _error = true;
+      return 0;
+    }
+
+    length = 0;
+    for (int i = 0; i < count; i++) {
+      length = (length << 8) | header[2 + i];
+    }
+    headerLength += count;
+  }
+
+  // checked before narrowing, so the length always fits in an int
+  if (length > (uint32_t)(remaining - headerLength)) {
+    _error = true;
+    return 0;
+  }
+
+  element.tag = header[0];
+  element.header = header;
+  element.value = &header[headerLength];
+  element.length = (int)length;
+
+  _offset += headerLength + (int)length;
+
+  return 1;
+}
+
+int ASN1Reader::next(int tag, ASN1Element& element)
+{
+  if (peek() != tag) {
+    return 0;
+  }
+
+  return next(element);
+}
+
+int ASN1Reader::peek()
+{
+  if (_error || atEnd()) {
+    return -1;
+  }
+
+  return _data[_offset];
+}
+
+bool ASN1Reader::atEnd()
+{
+  return (_offset >= _length);
+}
+
+bool ASN1Reader::error()
+{
+  return _error;
+}
+
+ASN1Writer::ASN1Writer(byte buffer[], int size) :
+  _buffer(buffer),
+  _size(size),
+  _length(0),
+  _overflow(false),
+  _depth(0)
+{
+}
+
+int ASN1Writer::begin(int tag)
+{
+  if (_depth == ASN1_WRITER_MAX_DEPTH) {
+    _overflow = true;
+    return 0;
+  }
+
+  // assume a short form length, end() makes room if needed
+  byte* header = reserve(2);
+
+  if (header == NULL) {
+    return 0;
+  }
+
+  header[0] = tag;
+  header[1] = 0x00;
+
+  _starts[_depth++] = _length - 2;
+
+  return 1;
+}
+
+int ASN1Writer::end()
+{
+  if (_depth == 0) {
+    _overflow = true;
+    return 0;
+  }
+
+  int start = _starts[--_depth];
+
+  if (_overflow) {
+    return 0;
+  }
+
+  byte* header = &_buffer[start];
+  int contentLength = _length - (start + 2);
+  int extra = 0;
+
+  if (contentLength > 0xffff) {
+    extra = 3;
+  } else if (contentLength > 0xff) {
+    extra = 2;
+  } else if (contentLength > 0x7f) {
+    extra = 1;
+  }
+
+  if (extra) {
+    if (_length + extra > _size) {
+      _overflow = true;
+      return 0;
+    }
+
+    memmove(&header[2 + extra], &header[2], contentLength);
+    _length += extra;
+
+    header[1] = 0x80 | extra;
+    for (int i = 0; i < extra; i++) {
+      header[1 + extra - i] = (contentLength >> (8 * i)) & 0xff;
+    }
+  } else {
+    header[1] = contentLength;
+  }
+
+  return 1;
+}
+
+int ASN1Writer::append(int tag, const byte data[], int length)
+{
+  if (!appendHeader(tag, length)) {
+    return 0;
+  }
+
+  return append(data, length);
+}
+
+int ASN1Writer::append(const byte data[], int length)
+{
+  byte* out = reserve(length);
+
+  if (out == NULL) {
+    return 0;
+  }
+
+  // data may point into this writer's own buffer
+  memmove(out, data, length);
+
+  return 1;
+}
+
+byte* ASN1Writer::reserve(int length)
+{
+  if (_overflow || length < 0 || length > (_size - _length)) {
+    _overflow = true;
+    return NULL;
+  }
+
+  byte* out = &_buffer[_length];
+  _length += length;
+
+  return out;
+}
+
+byte* ASN1Writer::data()
+{
+  return _buffer;
+}
+
+int ASN1Writer::length()
+{
+  return _length;
+}
+
+bool ASN1Writer::overflow()
+{
+  return _overflow;
+}
+
+int ASN1Writer::appendHeader(int tag, int length)
+{
+  int extra = 0;
+
+  if (length > 0xffff) {
+    extra = 3;
+  } else if (length > 0xff) {
+    extra = 2;
+  } else if (length > 0x7f) {
+    extra = 1;
+  }
+
+  byte* header = reserve(2 + extra);
+
+  if (header == NULL) {
+    return 0;
+  }
+
+  header[0] = tag;
+
+  if (extra) {
+    header[1] = 0x80 | extra;
+    for (int i = 0; i < extra; i++) {
+      header[1 + extra - i] = (length >> (8 * i)) & 0xff;
+    }
+  } else {
+    header[1] = length;
+  }
+
+  return 1;
+}
+
 ASN1UtilsClass ASN1Utils;
@@ -22,14 +22,89 @@
 
 #include <Arduino.h>
 
+#define ASN1_BOOLEAN           0x01
 #define ASN1_INTEGER           0x02
 #define ASN1_BIT_STRING        0x03
 #define ASN1_NULL              0x05
+#define ASN1_OCTET_STRING      0x04
 #define ASN1_OBJECT_IDENTIFIER 0x06
+#define ASN1_UTF8_STRING       0x0c
 #define ASN1_PRINTABLE_STRING  0x13
+#define ASN1_UTC_TIME          0x17
+#define ASN1_GENERALIZED_TIME  0x18
 #define ASN1_SEQUENCE          0x30
 #define ASN1_SET               0x31
 
+#ifndef ASN1_WRITER_MAX_DEPTH
+#define ASN1_WRITER_MAX_DEPTH  8
+#endif
+
+// Single pass DER writer into a caller provided buffer. Constructed
+// elements reserve a short header in begin(), end() backpatches the
+// length and moves the content if a longer header is needed.
+// Running out of space (or nesting) sets a sticky overflow flag.
+class ASN1Writer {
+public:
+  ASN1Writer(byte buffer[], int size);
+
+  int begin(int tag);
+  int end();
+
+  int append(int tag, const byte data[], int length);
+  int append(const byte data[], int length);
+  byte* reserve(int length);
+
+  byte* data();
+  int length();
+  bool overflow();
+
+private:
+  int appendHeader(int tag, int length);
+
+private:
+  byte* _buffer;
+  int _size;
+  int _length;
+  bool _overflow;
+
+  int _depth;
+  int _starts[ASN1_WRITER_MAX_DEPTH];
+};
+
+// A TLV inside a DER buffer, header points to the tag byte,
+// value to the first content byte. Nothing is copied.
+struct ASN1Element {
+  int tag;
+  const byte* header;
+  const byte* value;
+  int length;
+
+  int totalLength() const { return (value - header) + length; }
+};
+
+// Walks the elements of one nesting level of a DER buffer, use
+// the ASN1Element constructor to descend into constructed elements.
+// Malformed input (bad lengths, indefinite form, high tag numbers)
+// sets a sticky error flag.
+class ASN1Reader {
+public:
+  ASN1Reader(const byte data[], int length);
+  ASN1Reader(const ASN1Element& element);
+
+  int next(ASN1Element& element);
+  int next(int tag, ASN1Element& element);
+  int peek();
+
+  bool atEnd();
+  bool error();
+
+private:
+  const byte* _data;
+  int _length;
+  int _offset;
+  bool _error;
+};
+
 class ASN1UtilsClass {
 public:
   int versionLength();
@@ -72,6 +147,34 @@ public:
    int appendDate(int year, int month, int day, int hour, int minute, int second, byte out[]);
 
    int appendEcdsaWithSHA256(byte out[]);
+
+   int appendVersion(int version, ASN1Writer& out);
+
+   int appendIssuerOrSubject(const String& countryName,
+                             const String& stateProvinceName,
+                             const String& localityName,
+                             const String& organizationName,
+                             const String& organizationalUnitName,
+                             const String& commonName,
+                             ASN1Writer& out);
+
+   int appendPublicKey(const byte publicKey[], ASN1Writer& out);
+
+   int appendSignature(const byte signature[], ASN1Writer& out);
+
+   int appendSerialNumber(const byte serialNumber[], int length, ASN1Writer& out);
+
+   int appendName(const String& name, int type, ASN1Writer& out);
+
+   int appendDate(int year, int month, int day, int hour, int minute, int second, ASN1Writer& out);
+
+   int appendEcdsaWithSHA256(ASN1Writer& out);
+
+   int parsePublicKey(const ASN1Element& subjectPublicKeyInfo, byte publicKey[]);
+
+   int parseSignature(const ASN1Element& signature, byte rs[]);
+
+   bool oidEquals(const ASN1Element& oid, const byte value[], int length);
 };
 
 extern ASN1UtilsClass ASN1Utils;
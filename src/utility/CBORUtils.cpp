@@ -0,0 +1,262 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "CBORUtils.h"
+
+CBORWriter::CBORWriter(Print& out) :
+  _out(&out),
+  _error(false)
+{
+}
+
+int CBORWriter::appendUnsigned(uint64_t value)
+{
+  return appendHead(CBOR_UNSIGNED, value);
+}
+
+int CBORWriter::appendInt(int64_t value)
+{
+  if (value < 0) {
+    // -1 - n without overflowing on INT64_MIN
+    return appendHead(CBOR_NEGATIVE, ~(uint64_t)value);
+  }
+
+  return appendHead(CBOR_UNSIGNED, value);
+}
+
+int CBORWriter::appendBytes(const byte data[], size_t length)
+{
+  if (!appendHead(CBOR_BYTES, length)) {
+    return 0;
+  }
+
+  return appendRaw(data, length);
+}
+
+int CBORWriter::appendBytesHeader(size_t length)
+{
+  return appendHead(CBOR_BYTES, length);
+}
+
+int CBORWriter::appendText(const char* text)
+{
+  return appendText(text, strlen(text));
+}
+
+int CBORWriter::appendText(const char* text, size_t length)
+{
+  if (!appendHead(CBOR_TEXT, length)) {
+    return 0;
+  }
+
+  return appendRaw((const byte*)text, length);
+}
+
+int CBORWriter::appendArray(size_t count)
+{
+  return appendHead(CBOR_ARRAY, count);
+}
+
+int CBORWriter::appendMap(size_t count)
+{
+  return appendHead(CBOR_MAP, count);
+}
+
+int CBORWriter::appendTag(uint64_t tag)
+{
+  return appendHead(CBOR_TAG, tag);
+}
+
+int CBORWriter::appendRaw(const byte data[], size_t length)
+{
+  if (_error) {
+    return 0;
+  }
+
+  if (length > 0 && _out->write(data, length) != length) {
+    _error = true;
+    return 0;
+  }
+
+  return 1;
+}
+
+bool CBORWriter::error()
+{
+  return _error;
+}
+
+int CBORWriter::appendHead(int major, uint64_t value)
+{
+  byte head[9];
+  int length;
+
+  // shortest form of the argument
+  if (value < 24) {
+    head[0] = value;
+    length = 1;
+  } else if (value <= 0xff) {
+    head[0] = 24;
+    length = 2;
+  } else if (value <= 0xffff) {
+    head[0] = 25;
+    length = 3;
+  } else if (value <= 0xffffffff) {
+    head[0] = 26;
+    length = 5;
+  } else {
+    head[0] = 27;
+    length = 9;
+  }
+
+  head[0] |= (major << 5);
+
+  for (int i = length - 1; i > 0; i--) {
+    head[i] = value;
+    value >>= 8;
+  }
+
+  return appendRaw(head, length);
+}
+
+CBORReader::CBORReader(const byte data[], size_t length) :
+  _data(data),
+  _length(length),
+  _offset(0),
+  _error(false)
+{
+}
+
+int CBORReader::next(CBORItem& item)
+{
+  if (_error || atEnd()) {
+    return 0;
+  }
+
+  const byte* header = &_data[_offset];
+  size_t remaining = _length - _offset;
+  int additional = header[0] & 0x1f;
+  size_t headerLength = 1;
+  uint64_t value;
+
+  if (additional < 24) {
+    value = additional;
+  } else if (additional <= 27) {
+    // 1, 2, 4 or 8 argument bytes, no indefinite lengths
+    size_t count = 1 << (additional - 24);
+
+    if (remaining < 1 + count) {
+      _error = true;
+      return 0;
+    }
+
+    value = 0;
+    for (size_t i = 0; i < count; i++) {
+      value = (value << 8) | header[1 + i];
+    }
+
+    headerLength += count;
+  } else {
+    _error = true;
+    return 0;
+  }
+
+  item.major = header[0] >> 5;
+  item.value = value;
+  item.header = header;
+  item.data = &header[headerLength];
+
+  _offset += headerLength;
+
+  if (item.major == CBOR_BYTES || item.major == CBOR_TEXT) {
+    if (value > _length - _offset) {
+      _error = true;
+      return 0;
+    }
+
+    _offset += value;
+  }
+
+  return 1;
+}
+
+int CBORReader::next(int major, CBORItem& item)
+{
+  if (peek() != major) {
+    return 0;
+  }
+
+  return next(item);
+}
+
+// Skips one complete item, including the contents of arrays,
+// maps and tags
+int CBORReader::skip()
+{
+  uint64_t pending = 1;
+  CBORItem item;
+
+  while (pending > 0) {
+    if (!next(item)) {
+      _error = true;
+      return 0;
+    }
+    pending--;
+
+    // every nested item takes at least one byte
+    uint64_t remaining = _length - _offset;
+
+    if (item.major == CBOR_ARRAY) {
+      if (item.value > remaining) {
+        _error = true;
+        return 0;
+      }
+      pending += item.value;
+    } else if (item.major == CBOR_MAP) {
+      if (item.value > remaining / 2) {
+        _error = true;
+        return 0;
+      }
+      pending += 2 * item.value;
+    } else if (item.major == CBOR_TAG) {
+      pending++;
+    }
+  }
+
+  return 1;
+}
+
+int CBORReader::peek()
+{
+  if (_error || atEnd()) {
+    return -1;
+  }
+
+  return _data[_offset] >> 5;
+}
+
+bool CBORReader::atEnd()
+{
+  return (_offset >= _length);
+}
+
+bool CBORReader::error()
+{
+  return _error;
+}
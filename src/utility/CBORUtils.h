@@ -0,0 +1,96 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _CBOR_UTILS_H_
+#define _CBOR_UTILS_H_
+
+#include <Arduino.h>
+
+#define CBOR_UNSIGNED          0
+#define CBOR_NEGATIVE          1
+#define CBOR_BYTES             2
+#define CBOR_TEXT              3
+#define CBOR_ARRAY             4
+#define CBOR_MAP               5
+#define CBOR_TAG               6
+#define CBOR_SIMPLE            7
+
+// Streaming CBOR (RFC 8949) encoder, items go to the sink as they
+// are appended so nothing is buffered. Arrays, maps and strings
+// take their size up front, only definite lengths are written.
+// A short write to the sink sets a sticky error flag.
+class CBORWriter {
+public:
+  CBORWriter(Print& out);
+
+  int appendUnsigned(uint64_t value);
+  int appendInt(int64_t value);
+  int appendBytes(const byte data[], size_t length);
+  int appendBytesHeader(size_t length);
+  int appendText(const char* text);
+  int appendText(const char* text, size_t length);
+  int appendArray(size_t count);
+  int appendMap(size_t count);
+  int appendTag(uint64_t tag);
+  int appendRaw(const byte data[], size_t length);
+
+  bool error();
+
+private:
+  int appendHead(int major, uint64_t value);
+
+private:
+  Print* _out;
+  bool _error;
+};
+
+// A data item inside a CBOR buffer, header points to its first byte.
+// For strings value is the length and data points at the content,
+// for arrays and maps value is the number of items (pairs) that
+// follow, otherwise it is the argument. Nothing is copied.
+struct CBORItem {
+  int major;
+  uint64_t value;
+  const byte* header;
+  const byte* data;
+};
+
+// Walks the items of a CBOR buffer in order, the elements of an
+// array or map are the items following its head. Indefinite lengths
+// and reserved encodings set a sticky error flag.
+class CBORReader {
+public:
+  CBORReader(const byte data[], size_t length);
+
+  int next(CBORItem& item);
+  int next(int major, CBORItem& item);
+  int skip();
+  int peek();
+
+  bool atEnd();
+  bool error();
+
+private:
+  const byte* _data;
+  size_t _length;
+  size_t _offset;
+  bool _error;
+};
+
+#endif
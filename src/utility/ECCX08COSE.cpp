@@ -0,0 +1,282 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "ECCX08.h"
+
+#include "CBORUtils.h"
+#include "ECCX08JWS.h"
+#include "ECCX08SHA256.h"
+#include "PEMUtils.h"
+
+#include "ECCX08COSE.h"
+
+#define COSE_SIGN1_TAG        18
+#define COSE_HEADER_ALG       1
+#define COSE_ALG_ES256        -7
+
+// { 1: -7 }
+static const byte ES256_PROTECTED_HEADER[] = { 0xa1, 0x01, 0x26 };
+
+ECCX08COSEClass::ECCX08COSEClass()
+{
+}
+
+ECCX08COSEClass::~ECCX08COSEClass()
+{
+}
+
+/** \brief Signs payload and writes a tagged COSE_Sign1 message. The
+ *   payload is hashed and written in the same pass, the message is
+ *   about 75 bytes longer than the payload.
+ *
+ * \param[in] slot               Private key slot
+ * \param[in] payload            Payload
+ * \param[in] length             Length of the payload
+ * \param[out] out               Sink for the message
+ *
+ * \return 1 on success, otherwise 0. Part of the message may have
+ *   been written on failure.
+ */
+int ECCX08COSEClass::sign(int slot, const byte payload[], size_t length, Print& out)
+{
+  if (slot < 0 || slot > 8) {
+    return 0;
+  }
+
+  if (!ECCX08SHA256.begin()) {
+    return 0;
+  }
+
+  // Sig_structure = [ "Signature1", protected, external_aad, payload ]
+  CBORWriter sigStructure(ECCX08SHA256);
+
+  sigStructure.appendArray(4);
+  sigStructure.appendText("Signature1");
+  sigStructure.appendBytes(ES256_PROTECTED_HEADER, sizeof(ES256_PROTECTED_HEADER));
+  sigStructure.appendBytes(NULL, 0);
+  sigStructure.appendBytesHeader(length);
+
+  // COSE_Sign1 = [ protected, unprotected, payload, signature ]
+  CBORWriter message(out);
+
+  message.appendTag(COSE_SIGN1_TAG);
+  message.appendArray(4);
+  message.appendBytes(ES256_PROTECTED_HEADER, sizeof(ES256_PROTECTED_HEADER));
+  message.appendMap(0);
+  message.appendBytesHeader(length);
+
+  // the payload ends both structures
+  sigStructure.appendRaw(payload, length);
+  message.appendRaw(payload, length);
+
+  if (sigStructure.error() || message.error()) {
+    return 0;
+  }
+
+  byte sigStructureSha256[32];
+  byte signature[64];
+
+  if (!ECCX08SHA256.end(sigStructureSha256)) {
+    return 0;
+  }
+
+  if (!ECCX08.ecSign(slot, sigStructureSha256, signature)) {
+    return 0;
+  }
+
+  return message.appendBytes(signature, sizeof(signature));
+}
+
+/** \brief Signs payload into a buffer, see sign() above.
+ *
+ * \return The length of the message, 0 on failure or when it
+ *   does not fit.
+ */
+int ECCX08COSEClass::sign(int slot, const byte payload[], size_t length, byte out[], size_t size)
+{
+  BufferPrint buffer((char*)out, size);
+
+  if (!sign(slot, payload, length, buffer)) {
+    return 0;
+  }
+
+  if (buffer.length() > (int)size) {
+    return 0;
+  }
+
+  return buffer.length();
+}
+
+/** \brief Verifies a COSE_Sign1 message (tagged or untagged) with an
+ *   ES256 protected header. The message is parsed in place.
+ *
+ * \param[in] message            COSE_Sign1 message
+ * \param[in] length             Length of the message
+ * \param[in] publicKey          Public key (X and Y, 64 bytes)
+ * \param[out] payload           Optional, set to the payload inside message
+ * \param[out] payloadLength     Optional, set to the length of the payload
+ *
+ * \return 1 if the signature is valid, otherwise 0.
+ */
+int ECCX08COSEClass::verify(const byte message[], size_t length, const byte publicKey[], const byte** payload, size_t* payloadLength)
+{
+  CBORReader reader(message, length);
+  CBORItem item;
+  CBORItem protectedHeader;
+  CBORItem payloadItem;
+  CBORItem signature;
+
+  if (reader.peek() == CBOR_TAG) {
+    if (!reader.next(item) || item.value != COSE_SIGN1_TAG) {
+      return 0;
+    }
+  }
+
+  if (!reader.next(CBOR_ARRAY, item) || item.value != 4) {
+    return 0;
+  }
+
+  if (!reader.next(CBOR_BYTES, protectedHeader) ||
+      !isES256(protectedHeader.data, protectedHeader.value)) {
+    return 0;
+  }
+
+  // unprotected header, nothing in it is used
+  if (reader.peek() != CBOR_MAP || !reader.skip()) {
+    return 0;
+  }
+
+  // detached payloads (nil) are not supported
+  if (!reader.next(CBOR_BYTES, payloadItem)) {
+    return 0;
+  }
+
+  if (!reader.next(CBOR_BYTES, signature) || signature.value != 64 || !reader.atEnd()) {
+    return 0;
+  }
+
+  byte sigStructureSha256[32];
+
+  if (!hashSigStructure(protectedHeader.data, protectedHeader.value, payloadItem.data, payloadItem.value, sigStructureSha256)) {
+    return 0;
+  }
+
+  if (!ECCX08.ecdsaVerify(sigStructureSha256, signature.data, publicKey)) {
+    return 0;
+  }
+
+  if (payload) {
+    *payload = payloadItem.data;
+  }
+
+  if (payloadLength) {
+    *payloadLength = payloadItem.value;
+  }
+
+  return 1;
+}
+
+/** \brief Verifies a COSE_Sign1 message against the public key of a
+ *   slot. Slots 0 - 7 hold private keys and the public key is derived,
+ *   slots 8 - 15 hold a public key in the chip's 72 byte format.
+ *
+ * \return 1 if the signature is valid, otherwise 0.
+ */
+int ECCX08COSEClass::verify(const byte message[], size_t length, int slot, const byte** payload, size_t* payloadLength)
+{
+  byte publicKey[64];
+
+  if (slot < 0 || slot > 15) {
+    return 0;
+  }
+
+  if (slot < 8) {
+    // shares the public key cache with ECCX08JWS
+    if (!ECCX08JWS.cachedPublicKey(slot, publicKey)) {
+      return 0;
+    }
+  } else {
+    byte stored[72];
+
+    if (!ECCX08.readSlot(slot, stored, sizeof(stored))) {
+      return 0;
+    }
+
+    memcpy(&publicKey[0], &stored[4], 32);
+    memcpy(&publicKey[32], &stored[40], 32);
+  }
+
+  return verify(message, length, publicKey, payload, payloadLength);
+}
+
+int ECCX08COSEClass::hashSigStructure(const byte protectedHeader[], size_t protectedLength, const byte payload[], size_t length, byte result[])
+{
+  if (!ECCX08SHA256.begin()) {
+    return 0;
+  }
+
+  CBORWriter sigStructure(ECCX08SHA256);
+
+  sigStructure.appendArray(4);
+  sigStructure.appendText("Signature1");
+  sigStructure.appendBytes(protectedHeader, protectedLength);
+  sigStructure.appendBytes(NULL, 0);
+  sigStructure.appendBytes(payload, length);
+
+  if (sigStructure.error()) {
+    return 0;
+  }
+
+  return ECCX08SHA256.end(result);
+}
+
+// The protected header must be a map with alg (1) set to ES256 (-7)
+bool ECCX08COSEClass::isES256(const byte protectedHeader[], size_t length)
+{
+  CBORReader reader(protectedHeader, length);
+  CBORItem map;
+  CBORItem key;
+  CBORItem value;
+  bool es256 = false;
+
+  if (!reader.next(CBOR_MAP, map)) {
+    return false;
+  }
+
+  for (uint64_t i = 0; i < map.value; i++) {
+    // only integer and text string labels
+    if (!reader.next(key) || key.major > CBOR_TEXT || key.major == CBOR_BYTES) {
+      return false;
+    }
+
+    if (key.major == CBOR_UNSIGNED && key.value == COSE_HEADER_ALG) {
+      if (!reader.next(CBOR_NEGATIVE, value) || value.value != (uint64_t)(-1 - COSE_ALG_ES256)) {
+        return false;
+      }
+
+      es256 = true;
+    } else if (!reader.skip()) {
+      return false;
+    }
+  }
+
+  return es256 && reader.atEnd();
+}
+
+ECCX08COSEClass ECCX08COSE;
@@ -0,0 +1,45 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _ECCX08_COSE_H_
+#define _ECCX08_COSE_H_
+
+#include <Arduino.h>
+
+// COSE_Sign1 (RFC 9052) messages with ES256, the binary counterpart
+// of ECCX08JWS. The protected header only carries the algorithm.
+class ECCX08COSEClass {
+public:
+  ECCX08COSEClass();
+  virtual ~ECCX08COSEClass();
+
+  int sign(int slot, const byte payload[], size_t length, Print& out);
+  int sign(int slot, const byte payload[], size_t length, byte out[], size_t size);
+
+  int verify(const byte message[], size_t length, const byte publicKey[], const byte** payload = NULL, size_t* payloadLength = NULL);
+  int verify(const byte message[], size_t length, int slot, const byte** payload = NULL, size_t* payloadLength = NULL);
+
+private:
+  int hashSigStructure(const byte protectedHeader[], size_t protectedLength, const byte payload[], size_t length, byte result[]);
+  bool isES256(const byte protectedHeader[], size_t length);
+};
+
+extern ECCX08COSEClass ECCX08COSE;
+
+#endif
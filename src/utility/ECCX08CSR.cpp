@@ -20,16 +20,29 @@
 #include "ArduinoECCX08.h"
 
 #include "ASN1Utils.h"
+#include "ECCX08SHA256.h"
 #include "PEMUtils.h"
 
 #include "ECCX08CSR.h"
 
-ECCX08CSRClass::ECCX08CSRClass()
+ECCX08CSRClass::ECCX08CSRClass() :
+  _subjectAltNameCount(0),
+  _keyUsage(0),
+  _extendedKeyUsage(0),
+  _hasBasicConstraints(false),
+  _ca(false),
+  _pathLength(-1),
+  _template(NULL),
+  _templateLength(0),
+  _commonNameOffset(0),
+  _commonNameLength(0),
+  _publicKeyOffset(0)
 {
 }
 
 ECCX08CSRClass::~ECCX08CSRClass()
 {
+  clearTemplate();
 }
 
 int ECCX08CSRClass::begin(int slot, bool newPrivateKey)
@@ -51,121 +64,192 @@ int ECCX08CSRClass::begin(int slot, bool newPrivateKey)
 
 String ECCX08CSRClass::end()
 {
-  int versionLen = ASN1Utils.versionLength();
-  int subjectLen = ASN1Utils.issuerOrSubjectLength(_countryName,
-                                                    _stateProvinceName,
-                                                    _localityName,
-                                                    _organizationName,
-                                                    _organizationalUnitName,
-                                                    _commonName);
-  int subjectHeaderLen = ASN1Utils.sequenceHeaderLength(subjectLen);
-  int publicKeyLen = ASN1Utils.publicKeyLength();
+  String csr;
 
-  int csrInfoLen = versionLen + subjectHeaderLen + subjectLen + publicKeyLen + 2;
-  int csrInfoHeaderLen = ASN1Utils.sequenceHeaderLength(csrInfoLen);
+  csr.reserve(512);
 
-  byte csrInfo[csrInfoHeaderLen + csrInfoLen];
-  byte* out = csrInfo;
+  StringPrint out(csr);
 
-  ASN1Utils.appendSequenceHeader(csrInfoLen, out);
-  out += csrInfoHeaderLen;
+  if (!end(out)) {
+    return "";
+  }
+
+  return csr;
+}
+
+int ECCX08CSRClass::end(Print& out)
+{
+  // same subject apart from the common name value, patch in place. Subject
+  // alternative names are only referenced, so they could have changed.
+  if (_template != NULL && (int)_commonName.length() == _commonNameLength && _subjectAltNameCount == 0) {
+    memcpy(&_template[_commonNameOffset], _commonName.c_str(), _commonNameLength);
+    memcpy(&_template[_publicKeyOffset], _publicKey, sizeof(_publicKey));
+  } else if (!buildTemplate()) {
+    return 0;
+  }
+
+  byte csrInfoSha256[64];
+  byte signature[64];
+
+  if (!ECCX08SHA256.begin()) {
+    return 0;
+  }
+
+  ECCX08SHA256.write(_template, _templateLength);
+
+  if (!ECCX08SHA256.end(csrInfoSha256)) {
+    return 0;
+  }
+
+  if (!ECCX08.ecSign(_slot, csrInfoSha256, signature)) {
+    return 0;
+  }
+
+  // signature algorithm and value
+  byte signatureDer[96];
+  ASN1Writer signatureOut(signatureDer, sizeof(signatureDer));
+
+  ASN1Utils.appendSignature(signature, signatureOut);
+
+  if (signatureOut.overflow()) {
+    return 0;
+  }
+
+  byte header[4];
+  int headerLength = ASN1Utils.appendSequenceHeader(_templateLength + signatureOut.length(), header);
+
+  // the CSR is never assembled in RAM, its parts go straight to the encoder
+  if (out.print("-----BEGIN CERTIFICATE REQUEST-----\n") == 0) {
+    return 0;
+  }
+
+  Base64Encoder encoder(out);
+
+  encoder.write(header, headerLength);
+  encoder.write(_template, _templateLength);
+  encoder.write(signatureOut.data(), signatureOut.length());
+
+  if (!encoder.end()) {
+    return 0;
+  }
+
+  return (out.print("\n-----END CERTIFICATE REQUEST-----\n") != 0);
+}
+
+int ECCX08CSRClass::buildTemplate()
+{
+  clearTemplate();
+
+  // version, public key and all headers fit in 320 bytes
+  int size = 320 + ASN1Utils.issuerOrSubjectLength(_countryName,
+                                                   _stateProvinceName,
+                                                   _localityName,
+                                                   _organizationName,
+                                                   _organizationalUnitName,
+                                                   _commonName) +
+                   extensionsLength();
+
+  _template = (byte*)malloc(size);
+
+  if (_template == NULL) {
+    return 0;
+  }
+
+  ASN1Writer out(_template, size);
+
+  out.begin(ASN1_SEQUENCE);
 
   // version
   ASN1Utils.appendVersion(0x00, out);
-  out += versionLen;
 
-  // subject
-  ASN1Utils.appendSequenceHeader(subjectLen, out);
-  out += subjectHeaderLen;
+  // subject, the common name is its last value
   ASN1Utils.appendIssuerOrSubject(_countryName,
                                   _stateProvinceName,
                                   _localityName,
                                   _organizationName,
                                   _organizationalUnitName,
                                   _commonName, out);
-  out += subjectLen;
 
-  // public key
+  _commonNameLength = _commonName.length();
+  _commonNameOffset = out.length() - _commonNameLength;
+
+  // public key, X and Y are its last 64 bytes
   ASN1Utils.appendPublicKey(_publicKey, out);
-  out += publicKeyLen;
 
-  // terminator
-  *out++ = 0xa0;
-  *out++ = 0x00;
+  _publicKeyOffset = out.length() - sizeof(_publicKey);
 
-  byte csrInfoSha256[64];
-  byte signature[64];
+  // attributes
+  out.begin(0xa0);
+  appendExtensions(out);
+  out.end();
 
-  if (!ECCX08.beginSHA256()) {
-    return "";
-  }
+  // a long form length for the info sequence moves the content
+  int lengthBeforeEnd = out.length();
 
-  for (int i = 0; i < (csrInfoHeaderLen + csrInfoLen); i += 64) {
-    int chunkLength = (csrInfoHeaderLen + csrInfoLen) - i;
+  if (!out.end()) {
+    clearTemplate();
+    return 0;
+  }
 
-    if (chunkLength > 64) {
-      chunkLength = 64;
-    }
+  _templateLength = out.length();
 
-    if (chunkLength == 64) {
-      if (!ECCX08.updateSHA256(&csrInfo[i])) {
-        return "";
-      }
-    } else {
-      if (!ECCX08.endSHA256(&csrInfo[i], chunkLength, csrInfoSha256)) {
-        return "";
-      }
-    }
-  }
+  // give back the estimate's slack
+  byte* shrunk = (byte*)realloc(_template, _templateLength);
 
-  if (!ECCX08.ecSign(_slot, csrInfoSha256, signature)) {
-    return "";
+  if (shrunk) {
+    _template = shrunk;
   }
 
-  int signatureLen = ASN1Utils.signatureLength(signature);
-  int csrLen = csrInfoHeaderLen + csrInfoLen + signatureLen;
-  int csrHeaderLen = ASN1Utils.sequenceHeaderLength(csrLen);
+  _commonNameOffset += _templateLength - lengthBeforeEnd;
+  _publicKeyOffset += _templateLength - lengthBeforeEnd;
 
-  byte csr[csrLen + csrHeaderLen];
-  out = csr;
+  return 1;
+}
 
-  ASN1Utils.appendSequenceHeader(csrLen, out);
-  out += csrHeaderLen;
+void ECCX08CSRClass::clearTemplate()
+{
+  if (_template) {
+    free(_template);
+    _template = NULL;
+  }
 
-  // info
-  memcpy(out, csrInfo, csrInfoHeaderLen + csrInfoLen);
-  out += (csrInfoHeaderLen + csrInfoLen);
+  _templateLength = 0;
+}
 
-  // signature
-  ASN1Utils.appendSignature(signature, out);
-  out += signatureLen;
+// Changing any subject field but the common name needs a new template
+void ECCX08CSRClass::setSubjectField(String& field, const char* value)
+{
+  if (field == value) {
+    return;
+  }
 
-  return PEMUtils.base64Encode(csr, csrLen + csrHeaderLen, "-----BEGIN CERTIFICATE REQUEST-----\n", "\n-----END CERTIFICATE REQUEST-----\n");
+  field = value;
+  clearTemplate();
 }
 
 void ECCX08CSRClass::setCountryName(const char *countryName)
 {
-  _countryName = countryName;
+  setSubjectField(_countryName, countryName);
 }
 
 void ECCX08CSRClass::setStateProvinceName(const char* stateProvinceName)
 {
-  _stateProvinceName = stateProvinceName;
+  setSubjectField(_stateProvinceName, stateProvinceName);
 }
 
 void ECCX08CSRClass::setLocalityName(const char* localityName)
 {
-  _localityName = localityName;
+  setSubjectField(_localityName, localityName);
 }
 
 void ECCX08CSRClass::setOrganizationName(const char* organizationName)
 {
-  _organizationName = organizationName;
+  setSubjectField(_organizationName, organizationName);
 }
 
 void ECCX08CSRClass::setOrganizationalUnitName(const char* organizationalUnitName)
 {
-  _organizationalUnitName = organizationalUnitName;
+  setSubjectField(_organizationalUnitName, organizationalUnitName);
 }
 
 void ECCX08CSRClass::setCommonName(const char* commonName)
@@ -173,5 +257,209 @@ void ECCX08CSRClass::setCommonName(const char* commonName)
   _commonName = commonName;
 }
 
+int ECCX08CSRClass::addSubjectAltNameDNS(const char* name)
+{
+  return addSubjectAltName(0x82, (const byte*)name, strlen(name));
+}
+
+int ECCX08CSRClass::addSubjectAltNameURI(const char* uri)
+{
+  return addSubjectAltName(0x86, (const byte*)uri, strlen(uri));
+}
+
+// IPv4 (4 bytes) or IPv6 (16 bytes) address, this one is copied
+int ECCX08CSRClass::addSubjectAltNameIP(const byte address[], int length)
+{
+  if (length != 4 && length != 16) {
+    return 0;
+  }
+
+  if (!addSubjectAltName(0x87, NULL, length)) {
+    return 0;
+  }
+
+  memcpy(_subjectAltNames[_subjectAltNameCount - 1].address, address, length);
+
+  return 1;
+}
+
+void ECCX08CSRClass::setKeyUsage(int keyUsage)
+{
+  _keyUsage = keyUsage & 0xff;
+  clearTemplate();
+}
+
+void ECCX08CSRClass::setExtendedKeyUsage(int extendedKeyUsage)
+{
+  _extendedKeyUsage = extendedKeyUsage;
+  clearTemplate();
+}
+
+void ECCX08CSRClass::setBasicConstraints(bool ca, int pathLength)
+{
+  _hasBasicConstraints = true;
+  _ca = ca;
+  _pathLength = pathLength;
+  clearTemplate();
+}
+
+void ECCX08CSRClass::clearExtensions()
+{
+  _subjectAltNameCount = 0;
+  _keyUsage = 0;
+  _extendedKeyUsage = 0;
+  _hasBasicConstraints = false;
+  clearTemplate();
+}
+
+int ECCX08CSRClass::addSubjectAltName(int tag, const byte value[], int length)
+{
+  if (_subjectAltNameCount == ECCX08_CSR_MAX_SAN) {
+    return 0;
+  }
+
+  _subjectAltNames[_subjectAltNameCount].tag = tag;
+  _subjectAltNames[_subjectAltNameCount].value = value;
+  _subjectAltNames[_subjectAltNameCount].length = length;
+  _subjectAltNameCount++;
+
+  clearTemplate();
+
+  return 1;
+}
+
+int ECCX08CSRClass::extensionsLength()
+{
+  // extensionRequest attribute, and every extension without
+  // its value, fits in 160 bytes even with long form headers
+  int length = 160;
+
+  // tag and up to three length bytes per name
+  for (int i = 0; i < _subjectAltNameCount; i++) {
+    length += 4 + _subjectAltNames[i].length;
+  }
+
+  return length;
+}
+
+// extensionRequest (PKCS #9) attribute with the requested extensions,
+// nothing is written without extensions
+void ECCX08CSRClass::appendExtensions(ASN1Writer& out)
+{
+  static const byte EXTENSION_REQUEST_OID[] = { 0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x09, 0x0e };
+  static const byte SUBJECT_ALT_NAME_OID[] = { 0x55, 0x1d, 0x11 };
+  static const byte KEY_USAGE_OID[] = { 0x55, 0x1d, 0x0f };
+  static const byte EXTENDED_KEY_USAGE_OID[] = { 0x55, 0x1d, 0x25 };
+  static const byte BASIC_CONSTRAINTS_OID[] = { 0x55, 0x1d, 0x13 };
+  static const byte TRUE_VALUE[] = { 0xff };
+
+  if (_subjectAltNameCount == 0 && _keyUsage == 0 && _extendedKeyUsage == 0 && !_hasBasicConstraints) {
+    return;
+  }
+
+  out.begin(ASN1_SEQUENCE);
+  out.append(ASN1_OBJECT_IDENTIFIER, EXTENSION_REQUEST_OID, sizeof(EXTENSION_REQUEST_OID));
+  out.begin(ASN1_SET);
+  out.begin(ASN1_SEQUENCE);
+
+  if (_subjectAltNameCount > 0) {
+    out.begin(ASN1_SEQUENCE);
+    out.append(ASN1_OBJECT_IDENTIFIER, SUBJECT_ALT_NAME_OID, sizeof(SUBJECT_ALT_NAME_OID));
+    out.begin(ASN1_OCTET_STRING);
+    out.begin(ASN1_SEQUENCE);
+
+    for (int i = 0; i < _subjectAltNameCount; i++) {
+      const byte* value = _subjectAltNames[i].value;
+
+      if (value == NULL) {
+        value = _subjectAltNames[i].address;
+      }
+
+      out.append(_subjectAltNames[i].tag, value, _subjectAltNames[i].length);
+    }
+
+    out.end();
+    out.end();
+    out.end();
+  }
+
+  if (_keyUsage) {
+    // DER drops the trailing zero bits
+    byte bits[2] = { 0, (byte)_keyUsage };
+
+    while (!(bits[1] & (1 << bits[0]))) {
+      bits[0]++;
+    }
+
+    out.begin(ASN1_SEQUENCE);
+    out.append(ASN1_OBJECT_IDENTIFIER, KEY_USAGE_OID, sizeof(KEY_USAGE_OID));
+    out.append(ASN1_BOOLEAN, TRUE_VALUE, sizeof(TRUE_VALUE));
+    out.begin(ASN1_OCTET_STRING);
+    out.append(ASN1_BIT_STRING, bits, sizeof(bits));
+    out.end();
+    out.end();
+  }
+
+  if (_extendedKeyUsage) {
+    // id-kp arc, the last byte selects the purpose
+    byte purpose[] = { 0x2b, 0x06, 0x01, 0x05, 0x05, 0x07, 0x03, 0x00 };
+    static const byte PURPOSES[] = { 0x01, 0x02, 0x03, 0x04, 0x08, 0x09 };
+
+    out.begin(ASN1_SEQUENCE);
+    out.append(ASN1_OBJECT_IDENTIFIER, EXTENDED_KEY_USAGE_OID, sizeof(EXTENDED_KEY_USAGE_OID));
+    out.begin(ASN1_OCTET_STRING);
+    out.begin(ASN1_SEQUENCE);
+
+    for (unsigned int i = 0; i < sizeof(PURPOSES); i++) {
+      if (_extendedKeyUsage & (1 << i)) {
+        purpose[sizeof(purpose) - 1] = PURPOSES[i];
+        out.append(ASN1_OBJECT_IDENTIFIER, purpose, sizeof(purpose));
+      }
+    }
+
+    out.end();
+    out.end();
+    out.end();
+  }
+
+  if (_hasBasicConstraints) {
+    out.begin(ASN1_SEQUENCE);
+    out.append(ASN1_OBJECT_IDENTIFIER, BASIC_CONSTRAINTS_OID, sizeof(BASIC_CONSTRAINTS_OID));
+    out.append(ASN1_BOOLEAN, TRUE_VALUE, sizeof(TRUE_VALUE));
+    out.begin(ASN1_OCTET_STRING);
+    out.begin(ASN1_SEQUENCE);
+
+    // cA defaults to false and is left out
+    if (_ca) {
+      out.append(ASN1_BOOLEAN, TRUE_VALUE, sizeof(TRUE_VALUE));
+
+      if (_pathLength >= 0) {
+        // minimal big endian, with a leading zero if the top bit is set
+        unsigned long value = _pathLength;
+        byte pathLength[5];
+        int start = sizeof(pathLength);
+
+        do {
+          pathLength[--start] = value & 0xff;
+          value >>= 8;
+        } while (value);
+
+        if (pathLength[start] & 0x80) {
+          pathLength[--start] = 0x00;
+        }
+
+        out.append(ASN1_INTEGER, &pathLength[start], sizeof(pathLength) - start);
+      }
+    }
+
+    out.end();
+    out.end();
+    out.end();
+  }
+
+  out.end();
+  out.end();
+  out.end();
+}
 
 ECCX08CSRClass ECCX08CSR;
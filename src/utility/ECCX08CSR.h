@@ -22,6 +22,28 @@
 
 #include <Arduino.h>
 
+class ASN1Writer;
+
+#ifndef ECCX08_CSR_MAX_SAN
+#define ECCX08_CSR_MAX_SAN 4
+#endif
+
+#define KEY_USAGE_DIGITAL_SIGNATURE         0x80
+#define KEY_USAGE_NON_REPUDIATION           0x40
+#define KEY_USAGE_KEY_ENCIPHERMENT          0x20
+#define KEY_USAGE_DATA_ENCIPHERMENT         0x10
+#define KEY_USAGE_KEY_AGREEMENT             0x08
+#define KEY_USAGE_KEY_CERT_SIGN             0x04
+#define KEY_USAGE_CRL_SIGN                  0x02
+#define KEY_USAGE_ENCIPHER_ONLY             0x01
+
+#define EXTENDED_KEY_USAGE_SERVER_AUTH      0x01
+#define EXTENDED_KEY_USAGE_CLIENT_AUTH      0x02
+#define EXTENDED_KEY_USAGE_CODE_SIGNING     0x04
+#define EXTENDED_KEY_USAGE_EMAIL_PROTECTION 0x08
+#define EXTENDED_KEY_USAGE_TIME_STAMPING    0x10
+#define EXTENDED_KEY_USAGE_OCSP_SIGNING     0x20
+
 class ECCX08CSRClass {
 public:
   ECCX08CSRClass();
@@ -29,6 +51,7 @@ public:
 
   int begin(int slot, bool newPrivateKey = true);
   String end();
+  int end(Print& out);
 
   void setCountryName(const char *countryName);
   void setCountryName(const String& countryName) { setCountryName(countryName.c_str()); }
@@ -48,6 +71,24 @@ public:
   void setCommonName(const char* commonName);
   void setCommonName(const String& commonName) { setCommonName(commonName.c_str()); }
 
+  // subject alternative names are not copied, they must stay valid until end()
+  int addSubjectAltNameDNS(const char* name);
+  int addSubjectAltNameURI(const char* uri);
+  int addSubjectAltNameIP(const byte address[], int length);
+
+  void setKeyUsage(int keyUsage);
+  void setExtendedKeyUsage(int extendedKeyUsage);
+  void setBasicConstraints(bool ca, int pathLength = -1);
+  void clearExtensions();
+
+private:
+  void setSubjectField(String& field, const char* value);
+  int buildTemplate();
+  void clearTemplate();
+  int addSubjectAltName(int tag, const byte value[], int length);
+  int extensionsLength();
+  void appendExtensions(ASN1Writer& out);
+
 private:
   int _slot;
 
@@ -59,6 +100,28 @@ private:
   String _commonName;
 
   byte _publicKey[64];
+
+  struct {
+    int tag;
+    const byte* value;
+    int length;
+    byte address[16];
+  } _subjectAltNames[ECCX08_CSR_MAX_SAN];
+  int _subjectAltNameCount;
+
+  int _keyUsage;
+  int _extendedKeyUsage;
+  bool _hasBasicConstraints;
+  bool _ca;
+  int _pathLength;
+
+  // CertificationRequestInfo of the last CSR, later CSRs with the same
+  // subject only patch the common name and public key in place
+  byte* _template;
+  int _templateLength;
+  int _commonNameOffset;
+  int _commonNameLength;
+  int _publicKeyOffset;
 };
 
 extern ECCX08CSRClass ECCX08CSR;
@@ -0,0 +1,247 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "ECCX08.h"
+
+#include "ECCX08SHA256.h"
+#include "X509Certificate.h"
+
+#include "ECCX08ChainVerifier.h"
+
+ECCX08ChainVerifierClass::ECCX08ChainVerifierClass() :
+  _hasAnchor(false),
+  _cacheCount(0),
+  _cacheNext(0)
+{
+}
+
+ECCX08ChainVerifierClass::~ECCX08ChainVerifierClass()
+{
+}
+
+/** \brief Sets the public key all chains must lead to,
+ *   e.g. kept in flash. Clears the cache.
+ *
+ * \param[in] publicKey          P-256 public key X and Y
+ *                               (64 bytes)
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08ChainVerifierClass::setTrustAnchor(const byte publicKey[])
+{
+  memcpy(_anchor, publicKey, sizeof(_anchor));
+  _hasAnchor = true;
+
+  clearCache();
+
+  return 1;
+}
+
+/** \brief Reads the trust anchor from a public key slot, stored in
+ *   the chip's 72 byte format (4 pad bytes before X and before Y).
+ *   Clears the cache.
+ *
+ * \param[in] slot               Public key slot (8 to 15)
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08ChainVerifierClass::setTrustAnchorSlot(int slot)
+{
+  byte stored[72];
+
+  _hasAnchor = false;
+  clearCache();
+
+  if (slot < 8 || slot > 15) {
+    return 0;
+  }
+
+  if (!ECCX08.readSlot(slot, stored, sizeof(stored))) {
+    return 0;
+  }
+
+  memcpy(&_anchor[0], &stored[4], 32);
+  memcpy(&_anchor[32], &stored[40], 32);
+  _hasAnchor = true;
+
+  return 1;
+}
+
+/** \brief Verifies a certificate chain against the trust anchor.
+ *
+ * Every link must be signed with ecdsa-with-SHA256, name its issuer
+ * by the issuer certificate's subject and every issuer must be a CA.
+ * The TBS digests of verified certificates are cached, a chain is
+ * accepted as soon as it reaches a cached certificate. Validity
+ * dates are not checked, the chip has no clock.
+ *
+ * \param[in] certificates       DER certificates, leaf first
+ * \param[in] lengths            The length of each certificate
+ * \param[in] count              Number of certificates, at most
+ *                               ECCX08_CHAIN_MAX_LENGTH
+ *
+ * \return 1 if the chain is valid, otherwise 0.
+ */
+int ECCX08ChainVerifierClass::verify(const byte* certificates[], const int lengths[], int count)
+{
+  X509Certificate certificate;
+  X509Certificate issuer;
+  byte tbsSha256[ECCX08_CHAIN_MAX_LENGTH][32];
+  byte issuerPublicKey[64];
+  int verified = 0;
+
+  if (!_hasAnchor || count < 1 || count > ECCX08_CHAIN_MAX_LENGTH) {
+    return 0;
+  }
+
+  if (!certificate.begin(certificates[0], lengths[0])) {
+    return 0;
+  }
+
+  for (int i = 0; i < count; i++) {
+    const byte* issuerKey = _anchor;
+
+    if (i + 1 < count) {
+      if (!issuer.begin(certificates[i + 1], lengths[i + 1])) {
+        return 0;
+      }
+
+      const ASN1Element& issuerName = certificate.issuer();
+      const ASN1Element& subjectName = issuer.subject();
+
+      if (issuerName.totalLength() != subjectName.totalLength() ||
+          memcmp(issuerName.header, subjectName.header, issuerName.totalLength()) != 0) {
+        return 0;
+      }
+
+      if (!isCA(issuer) || !issuer.publicKey(issuerPublicKey)) {
+        return 0;
+      }
+      issuerKey = issuerPublicKey;
+    }
+
+    int result = verifyLink(certificate, issuerKey, tbsSha256[verified]);
+
+    if (result == 0) {
+      return 0;
+    }
+
+    if (result < 0) {
+      // already verified up to the anchor
+      break;
+    }
+
+    verified++;
+
+    certificate = issuer;
+  }
+
+  // only cache links once the whole chain reached the anchor, a
+  // failed chain must not leave its leaf trusted
+  for (int i = 0; i < verified; i++) {
+    cache(tbsSha256[i]);
+  }
+
+  return 1;
+}
+
+/** \brief Forgets all previously verified certificates
+ */
+void ECCX08ChainVerifierClass::clearCache()
+{
+  _cacheCount = 0;
+  _cacheNext = 0;
+}
+
+int ECCX08ChainVerifierClass::verifyLink(X509Certificate& certificate, const byte issuerPublicKey[], byte tbsSha256[])
+{
+  const ASN1Element& tbs = certificate.tbsCertificate();
+  byte signature[64];
+
+  if (!ECCX08SHA256.begin()) {
+    return 0;
+  }
+
+  ECCX08SHA256.write(tbs.header, tbs.totalLength());
+
+  if (!ECCX08SHA256.end(tbsSha256)) {
+    return 0;
+  }
+
+  if (cached(tbsSha256)) {
+    return -1;
+  }
+
+  if (!certificate.isEcdsaWithSHA256() || !certificate.signature(signature)) {
+    return 0;
+  }
+
+  return ECCX08.ecdsaVerify(tbsSha256, signature, issuerPublicKey);
+}
+
+bool ECCX08ChainVerifierClass::isCA(X509Certificate& certificate)
+{
+  static const byte BASIC_CONSTRAINTS[] = { 0x55, 0x1d, 0x13 };
+
+  ASN1Element value;
+
+  // BasicConstraints ::= SEQUENCE { cA BOOLEAN DEFAULT FALSE, ... }
+  if (!certificate.extension(BASIC_CONSTRAINTS, sizeof(BASIC_CONSTRAINTS), value)) {
+    return false;
+  }
+
+  ASN1Reader octets(value);
+  ASN1Element constraints;
+  ASN1Element ca;
+
+  if (!octets.next(ASN1_SEQUENCE, constraints)) {
+    return false;
+  }
+
+  ASN1Reader fields(constraints);
+
+  return (fields.next(ASN1_BOOLEAN, ca) && ca.length == 1 && ca.value[0] != 0x00);
+}
+
+int ECCX08ChainVerifierClass::cached(const byte tbsSha256[])
+{
+  for (int i = 0; i < _cacheCount; i++) {
+    if (memcmp(_cache[i], tbsSha256, 32) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void ECCX08ChainVerifierClass::cache(const byte tbsSha256[])
+{
+  if (cached(tbsSha256)) {
+    return;
+  }
+
+  memcpy(_cache[_cacheNext], tbsSha256, 32);
+  _cacheNext = (_cacheNext + 1) % ECCX08_CHAIN_CACHE_SIZE;
+
+  if (_cacheCount < ECCX08_CHAIN_CACHE_SIZE) {
+    _cacheCount++;
+  }
+}
+
+ECCX08ChainVerifierClass ECCX08ChainVerifier;
@@ -0,0 +1,69 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _ECCX08_CHAIN_VERIFIER_H_
+#define _ECCX08_CHAIN_VERIFIER_H_
+
+#include <Arduino.h>
+
+#ifndef ECCX08_CHAIN_CACHE_SIZE
+#ifdef __AVR__
+#define ECCX08_CHAIN_CACHE_SIZE 2
+#else
+#define ECCX08_CHAIN_CACHE_SIZE 4
+#endif
+#endif
+
+#ifndef ECCX08_CHAIN_MAX_LENGTH
+#define ECCX08_CHAIN_MAX_LENGTH 4
+#endif
+
+class X509Certificate;
+
+class ECCX08ChainVerifierClass {
+public:
+  ECCX08ChainVerifierClass();
+  virtual ~ECCX08ChainVerifierClass();
+
+  int setTrustAnchor(const byte publicKey[]);
+  int setTrustAnchorSlot(int slot);
+
+  int verify(const byte* certificates[], const int lengths[], int count);
+
+  void clearCache();
+
+private:
+  int verifyLink(X509Certificate& certificate, const byte issuerPublicKey[], byte tbsSha256[]);
+  bool isCA(X509Certificate& certificate);
+
+  int cached(const byte tbsSha256[]);
+  void cache(const byte tbsSha256[]);
+
+private:
+  byte _anchor[64];
+  bool _hasAnchor;
+
+  byte _cache[ECCX08_CHAIN_CACHE_SIZE][32];
+  int _cacheCount;
+  int _cacheNext;
+};
+
+extern ECCX08ChainVerifierClass ECCX08ChainVerifier;
+
+#endif
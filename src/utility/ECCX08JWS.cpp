@@ -20,50 +20,36 @@
 #include "ECCX08.h"
 
 #include "ASN1Utils.h"
+#include "ECCX08SHA256.h"
 #include "PEMUtils.h"
 
 #include "ECCX08JWS.h"
 
-static String base64urlEncode(const byte in[], unsigned int length)
-{
-  static const char* CODES = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_=";
-
-  int b;
-  String out;
-
-  int reserveLength = 4 * ((length + 2) / 3);
-  out.reserve(reserveLength);
-
-  for (unsigned int i = 0; i < length; i += 3) {
-    b = (in[i] & 0xFC) >> 2;
-    out += CODES[b];
-
-    b = (in[i] & 0x03) << 4;
-    if (i + 1 < length) {
-      b |= (in[i + 1] & 0xF0) >> 4;
-      out += CODES[b];
-      b = (in[i + 1] & 0x0F) << 2;
-      if (i + 2 < length) {
-         b |= (in[i + 2] & 0xC0) >> 6;
-         out += CODES[b];
-         b = in[i + 2] & 0x3F;
-         out += CODES[b];
-      } else {
-        out += CODES[b];
-      }
-    } else {
-      out += CODES[b];
-    }
+// Forwards everything written to it to two sinks
+class TeePrint : public Print {
+public:
+  TeePrint(Print& first, Print& second) : _first(&first), _second(&second) {}
+
+  virtual size_t write(uint8_t b) {
+    return write(&b, 1);
   }
 
-  while (out.lastIndexOf('=') != -1) {
-    out.remove(out.length() - 1);
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    if (_first->write(buffer, size) != size || _second->write(buffer, size) != size) {
+      return 0;
+    }
+
+    return size;
   }
 
-  return out;
-}
+private:
+  Print* _first;
+  Print* _second;
+};
 
-ECCX08JWSClass::ECCX08JWSClass()
+ECCX08JWSClass::ECCX08JWSClass() :
+  _cacheCount(0),
+  _cacheNext(0)
 {
 }
 
@@ -83,8 +69,10 @@ String ECCX08JWSClass::publicKey(int slot, bool newPrivateKey)
     if (!ECCX08.generatePrivateKey(slot, publicKey)) {
       return "";
     }
+
+    cache(slot, publicKey);
   } else {
-    if (!ECCX08.generatePublicKey(slot, publicKey)) {
+    if (!cachedPublicKey(slot, publicKey)) {
       return "";
     }
   }
@@ -97,67 +85,547 @@ String ECCX08JWSClass::publicKey(int slot, bool newPrivateKey)
   return PEMUtils.base64Encode(out, length, "-----BEGIN PUBLIC KEY-----\n", "\n-----END PUBLIC KEY-----\n");
 }
 
+// Writes the slot's public key as a JWK, with the members in the
+// RFC 7638 order and no whitespace
+int ECCX08JWSClass::jwk(int slot, Print& out)
+{
+  byte publicKey[64];
+
+  if (!cachedPublicKey(slot, publicKey)) {
+    return 0;
+  }
+
+  return printJWK(publicKey, out);
+}
+
+int ECCX08JWSClass::jwk(int slot, char out[], int size)
+{
+  BufferPrint buffer(out, size);
+
+  if (!jwk(slot, buffer)) {
+    return 0;
+  }
+
+  // room for the terminator
+  if (buffer.length() >= size) {
+    return 0;
+  }
+  out[buffer.length()] = '\0';
+
+  return buffer.length();
+}
+
+// RFC 7638 SHA-256 thumbprint of the slot's public key
+int ECCX08JWSClass::thumbprint(int slot, byte result[])
+{
+  byte publicKey[64];
+
+  if (!cachedPublicKey(slot, publicKey)) {
+    return 0;
+  }
+
+  int index = cacheEntry(slot);
+
+  if (_cache[index].hasThumbprint) {
+    memcpy(result, _cache[index].thumbprint, 32);
+    return 1;
+  }
+
+  if (!ECCX08SHA256.begin()) {
+    return 0;
+  }
+
+  if (!printJWK(publicKey, ECCX08SHA256) || !ECCX08SHA256.end(result)) {
+    return 0;
+  }
+
+  memcpy(_cache[index].thumbprint, result, 32);
+  _cache[index].hasThumbprint = true;
+
+  return 1;
+}
+
+// Writes the thumbprint base64url encoded, as used in ACME key authorizations
+int ECCX08JWSClass::thumbprint(int slot, Print& out)
+{
+  byte result[32];
+
+  if (!thumbprint(slot, result)) {
+    return 0;
+  }
+
+  return PEMUtils.base64urlEncode(result, sizeof(result), out);
+}
+
+// Entries already follow GenKey through privateKeyGeneration(), this
+// only frees them
+void ECCX08JWSClass::clearCache()
+{
+  _cacheCount = 0;
+  _cacheNext = 0;
+}
+
 String ECCX08JWSClass::sign(int slot, const char* header, const char* payload)
 {
-  if (slot < 0 || slot > 8) {
+  String result;
+
+  // base64url of header, payload and the 64 byte signature plus the dots
+  result.reserve((4 * strlen(header) + 2) / 3 + (4 * strlen(payload) + 2) / 3 + 88);
+
+  StringPrint out(result);
+
+  if (!sign(slot, header, payload, out)) {
     return "";
   }
 
-  String encodedHeader = base64urlEncode((const byte*)header, strlen(header));
-  String encodedPayload = base64urlEncode((const byte*)payload, strlen(payload));
+  return result;
+}
 
-  String toSign;
-  toSign.reserve(encodedHeader.length() + 1 + encodedPayload.length());
+// The encoded header and payload are hashed as they are written
+// to out, so the token is never held in RAM. Part of the token may
+// have been written when this fails.
+int ECCX08JWSClass::sign(int slot, const char* header, const char* payload, Print& out)
+{
+  if (slot < 0 || slot > 8) {
+    return 0;
+  }
+
+  if (!ECCX08SHA256.begin()) {
+    return 0;
+  }
 
-  toSign += encodedHeader;
-  toSign += '.';
-  toSign += encodedPayload;
+  TeePrint signingInput(ECCX08SHA256, out);
 
+  if (!PEMUtils.base64urlEncode((const byte*)header, strlen(header), signingInput) ||
+      signingInput.write('.') != 1 ||
+      !PEMUtils.base64urlEncode((const byte*)payload, strlen(payload), signingInput)) {
+    return 0;
+  }
 
-  byte toSignSha256[32];
+  byte signingInputSha256[32];
   byte signature[64];
 
-  if (!ECCX08.beginSHA256()) {
-    return "";
+  if (!ECCX08SHA256.end(signingInputSha256)) {
+    return 0;
+  }
+
+  if (!ECCX08.ecSign(slot, signingInputSha256, signature)) {
+    return 0;
   }
 
-  for (unsigned int i = 0; i < toSign.length(); i += 64) {
-    int chunkLength = toSign.length() - i;
+  if (out.write('.') != 1) {
+    return 0;
+  }
+
+  return PEMUtils.base64urlEncode(signature, sizeof(signature), out);
+}
+
+String ECCX08JWSClass::sign(int slot, const String& header, const String& payload)
+{
+  return sign(slot, header.c_str(), payload.c_str());
+}
+
+int ECCX08JWSClass::verify(const char* token, const byte publicKey[])
+{
+  return verify(token, strlen(token), publicKey);
+}
+
+// Slots 0 - 7 hold private keys and the public key is derived,
+// slots 8 - 15 hold a public key in the chip's 72 byte format
+int ECCX08JWSClass::verify(const char* token, int slot)
+{
+  byte publicKey[64];
+
+  if (slot < 0 || slot > 15) {
+    return 0;
+  }
 
-    if (chunkLength > 64) {
-      chunkLength = 64;
+  if (slot < 8) {
+    if (!cachedPublicKey(slot, publicKey)) {
+      return 0;
     }
+  } else {
+    byte stored[72];
 
-    if (chunkLength == 64) {
-      if (!ECCX08.updateSHA256((const byte*)toSign.c_str() + i)) {
-        return "";
-      }
-    } else {
-      if (!ECCX08.endSHA256((const byte*)toSign.c_str() + i, chunkLength, toSignSha256)) {
-        return "";
-      }
+    if (!ECCX08.readSlot(slot, stored, sizeof(stored))) {
+      return 0;
     }
+
+    memcpy(&publicKey[0], &stored[4], 32);
+    memcpy(&publicKey[32], &stored[40], 32);
   }
 
-  if (!ECCX08.ecSign(slot, toSignSha256, signature)) {
-    return "";
+  return verify(token, strlen(token), publicKey);
+}
+
+// Verifies a compact ES256 JWS in place, the signing input is hashed
+// straight from the token. The header is not parsed, the signature is
+// only ever checked as ES256. On success payload points at the still
+// base64url encoded payload inside the token.
+int ECCX08JWSClass::verify(const char* token, size_t length, const byte publicKey[], const char** payload, size_t* payloadLength)
+{
+  const char* headerEnd = (const char*)memchr(token, '.', length);
+
+  if (!headerEnd) {
+    return 0;
   }
 
-  String encodedSignature = base64urlEncode(signature, sizeof(signature));
+  const char* payloadStart = headerEnd + 1;
+  const char* payloadEnd = (const char*)memchr(payloadStart, '.', length - (payloadStart - token));
 
-  String result;
-  result.reserve(toSign.length() + 1 + encodedSignature.length());
+  if (!payloadEnd) {
+    return 0;
+  }
 
-  result += toSign;
-  result += '.';
-  result += encodedSignature;
+  const char* signatureStart = payloadEnd + 1;
+  size_t signatureLength = length - (signatureStart - token);
+  byte signature[64];
 
-  return result;
+  if (PEMUtils.base64urlDecode(signatureStart, signatureLength, signature, sizeof(signature)) != (int)sizeof(signature)) {
+    return 0;
+  }
+
+  byte signingInputSha256[32];
+
+  if (!ECCX08SHA256.begin()) {
+    return 0;
+  }
+
+  ECCX08SHA256.write((const uint8_t*)token, payloadEnd - token);
+
+  if (!ECCX08SHA256.end(signingInputSha256)) {
+    return 0;
+  }
+
+  if (!ECCX08.ecdsaVerify(signingInputSha256, signature, publicKey)) {
+    return 0;
+  }
+
+  if (payload) {
+    *payload = payloadStart;
+  }
+
+  if (payloadLength) {
+    *payloadLength = payloadEnd - payloadStart;
+  }
+
+  return 1;
 }
 
-String ECCX08JWSClass::sign(int slot, const String& header, const String& payload)
+// The slot's public key from the cache, a GenKey only on a miss
+int ECCX08JWSClass::cachedPublicKey(int slot, byte publicKey[])
 {
-  return sign(slot, header.c_str(), payload.c_str());
+  if (slot < 0 || slot > 8) {
+    return 0;
+  }
+
+  int index = cacheEntry(slot);
+
+  // entries taken before the slot's key was regenerated (by any caller) are stale
+  if (index >= 0 && _cache[index].keyGeneration == ECCX08.privateKeyGeneration(slot)) {
+    memcpy(publicKey, _cache[index].publicKey, 64);
+    return 1;
+  }
+
+  if (!ECCX08.generatePublicKey(slot, publicKey)) {
+    return 0;
+  }
+
+  cache(slot, publicKey);
+
+  return 1;
+}
+
+int ECCX08JWSClass::cacheEntry(int slot)
+{
+  for (int i = 0; i < _cacheCount; i++) {
+    if (_cache[i].slot == slot) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+void ECCX08JWSClass::cache(int slot, const byte publicKey[])
+{
+  int index = cacheEntry(slot);
+
+  if (index < 0) {
+    index = _cacheNext;
+    _cacheNext = (_cacheNext + 1) % ECCX08_JWK_CACHE_SIZE;
+
+    if (_cacheCount < ECCX08_JWK_CACHE_SIZE) {
+      _cacheCount++;
+    }
+  }
+
+  _cache[index].slot = slot;
+  _cache[index].keyGeneration = ECCX08.privateKeyGeneration(slot);
+  memcpy(_cache[index].publicKey, publicKey, 64);
+  _cache[index].hasThumbprint = false;
+}
+
+int ECCX08JWSClass::printJWK(const byte publicKey[], Print& out)
+{
+  out.print("{\"crv\":\"P-256\",\"kty\":\"EC\",\"x\":\"");
+
+  if (!PEMUtils.base64urlEncode(&publicKey[0], 32, out)) {
+    return 0;
+  }
+
+  out.print("\",\"y\":\"");
+
+  if (!PEMUtils.base64urlEncode(&publicKey[32], 32, out)) {
+    return 0;
+  }
+
+  return (out.print("\"}") == 2);
 }
 
 ECCX08JWSClass ECCX08JWS;
+
+ECCX08JWTClass::ECCX08JWTClass() :
+  _slot(-1),
+  _headerLength(0),
+  _audience(NULL),
+  _lifetime(3600),
+  _renewBefore(300),
+  _claimCount(0),
+  _tokenValid(false),
+  _issuedAt(0),
+  _expiry(0)
+{
+}
+
+ECCX08JWTClass::~ECCX08JWTClass()
+{
+}
+
+int ECCX08JWTClass::begin(int slot, const char* kid)
+{
+  if (slot < 0 || slot > 8) {
+    return 0;
+  }
+
+  // the header is the same for every token from this slot
+  BufferPrint header(_header, sizeof(_header));
+  Base64Encoder encoder(header, 0, true);
+
+  encoder.print("{\"alg\":\"ES256\",\"typ\":\"JWT\"");
+
+  if (kid) {
+    encoder.print(",\"kid\":");
+    printString(encoder, kid);
+  }
+
+  encoder.print("}");
+  encoder.end();
+
+  // room for the terminator
+  if (header.length() >= (int)sizeof(_header)) {
+    return 0;
+  }
+
+  _header[header.length()] = '\0';
+  _headerLength = header.length();
+  _slot = slot;
+
+  invalidate();
+
+  return 1;
+}
+
+void ECCX08JWTClass::end()
+{
+  _slot = -1;
+
+  invalidate();
+}
+
+void ECCX08JWTClass::setAudience(const char* audience)
+{
+  _audience = audience;
+
+  invalidate();
+}
+
+void ECCX08JWTClass::setLifetime(unsigned long lifetime)
+{
+  _lifetime = lifetime;
+
+  invalidate();
+}
+
+void ECCX08JWTClass::setRenewBefore(unsigned long renewBefore)
+{
+  _renewBefore = renewBefore;
+}
+
+int ECCX08JWTClass::addClaim(const char* name, const char* value)
+{
+  if (_claimCount == ECCX08_JWT_MAX_CLAIMS) {
+    return 0;
+  }
+
+  _claims[_claimCount].name = name;
+  _claims[_claimCount].stringValue = value;
+  _claims[_claimCount].numberValue = 0;
+  _claimCount++;
+
+  invalidate();
+
+  return 1;
+}
+
+int ECCX08JWTClass::addClaim(const char* name, long value)
+{
+  if (_claimCount == ECCX08_JWT_MAX_CLAIMS) {
+    return 0;
+  }
+
+  _claims[_claimCount].name = name;
+  _claims[_claimCount].stringValue = NULL;
+  _claims[_claimCount].numberValue = value;
+  _claimCount++;
+
+  invalidate();
+
+  return 1;
+}
+
+void ECCX08JWTClass::clearClaims()
+{
+  _claimCount = 0;
+
+  invalidate();
+}
+
+// Returns a token valid at now (seconds since the epoch), signing a
+// new one only when the previous one is about to expire. The result
+// stays valid until the next call, NULL on failure.
+const char* ECCX08JWTClass::token(unsigned long now)
+{
+  if (_slot < 0) {
+    return NULL;
+  }
+
+  if (_tokenValid && now >= _issuedAt && now + _renewBefore < _expiry) {
+    return _token;
+  }
+
+  if (!build(now)) {
+    invalidate();
+    return NULL;
+  }
+
+  return _token;
+}
+
+unsigned long ECCX08JWTClass::expiry()
+{
+  return _tokenValid ? _expiry : 0;
+}
+
+void ECCX08JWTClass::invalidate()
+{
+  _tokenValid = false;
+}
+
+int ECCX08JWTClass::build(unsigned long now)
+{
+  BufferPrint token(_token, sizeof(_token));
+
+  if (!ECCX08SHA256.begin()) {
+    return 0;
+  }
+
+  TeePrint signingInput(ECCX08SHA256, token);
+  Base64Encoder payload(signingInput, 0, true);
+
+  signingInput.write((const uint8_t*)_header, _headerLength);
+  signingInput.write('.');
+
+  printClaims(payload, now, now + _lifetime);
+
+  if (!payload.end()) {
+    return 0;
+  }
+
+  byte signingInputSha256[32];
+  byte signature[64];
+
+  if (!ECCX08SHA256.end(signingInputSha256)) {
+    return 0;
+  }
+
+  if (!ECCX08.ecSign(_slot, signingInputSha256, signature)) {
+    return 0;
+  }
+
+  token.write('.');
+  PEMUtils.base64urlEncode(signature, sizeof(signature), token);
+
+  // room for the terminator
+  if (token.length() >= (int)sizeof(_token)) {
+    return 0;
+  }
+
+  _token[token.length()] = '\0';
+  _issuedAt = now;
+  _expiry = now + _lifetime;
+  _tokenValid = true;
+
+  return 1;
+}
+
+void ECCX08JWTClass::printClaims(Print& out, unsigned long issuedAt, unsigned long expiry)
+{
+  out.print("{\"iat\":");
+  out.print(issuedAt);
+  out.print(",\"exp\":");
+  out.print(expiry);
+
+  if (_audience) {
+    out.print(",\"aud\":");
+    printString(out, _audience);
+  }
+
+  for (int i = 0; i < _claimCount; i++) {
+    out.print(',');
+    printString(out, _claims[i].name);
+    out.print(':');
+
+    if (_claims[i].stringValue) {
+      printString(out, _claims[i].stringValue);
+    } else {
+      out.print(_claims[i].numberValue);
+    }
+  }
+
+  out.print('}');
+}
+
+void ECCX08JWTClass::printString(Print& out, const char* s)
+{
+  static const char* HEX_DIGITS = "0123456789abcdef";
+
+  out.print('"');
+
+  for (; *s; s++) {
+    char c = *s;
+
+    if (c == '"' || c == '\\') {
+      out.print('\\');
+      out.print(c);
+    } else if ((uint8_t)c < 0x20) {
+      out.print("\\u00");
+      out.print(HEX_DIGITS[c >> 4]);
+      out.print(HEX_DIGITS[c & 0x0f]);
+    } else {
+      out.print(c);
+    }
+  }
+
+  out.print('"');
+}
@@ -22,6 +22,10 @@
 
 #include <Arduino.h>
 
+#ifndef ECCX08_JWK_CACHE_SIZE
+#define ECCX08_JWK_CACHE_SIZE 2
+#endif
+
 class ECCX08JWSClass {
 public:
   ECCX08JWSClass();
@@ -29,10 +33,106 @@ public:
 
   String publicKey(int slot, bool newPrivateKey = true);
 
+  int jwk(int slot, Print& out);
+  int jwk(int slot, char out[], int size);
+  int thumbprint(int slot, byte result[]);
+  int thumbprint(int slot, Print& out);
+  int cachedPublicKey(int slot, byte publicKey[]);
+  void clearCache();
+
   String sign(int slot, const char* header, const char* payload);
   String sign(int slot, const String& header, const String& payload);
+  int sign(int slot, const char* header, const char* payload, Print& out);
+
+  int verify(const char* token, const byte publicKey[]);
+  int verify(const char* token, int slot);
+  int verify(const char* token, size_t length, const byte publicKey[], const char** payload = NULL, size_t* payloadLength = NULL);
+
+private:
+  int cacheEntry(int slot);
+  void cache(int slot, const byte publicKey[]);
+  int printJWK(const byte publicKey[], Print& out);
+
+private:
+  // public keys (and thumbprints) of recently used slots, saves a GenKey per use
+  struct {
+    int slot;
+    uint8_t keyGeneration;
+    byte publicKey[64];
+    byte thumbprint[32];
+    bool hasThumbprint;
+  } _cache[ECCX08_JWK_CACHE_SIZE];
+  int _cacheCount;
+  int _cacheNext;
 };
 
 extern ECCX08JWSClass ECCX08JWS;
 
+#ifndef ECCX08_JWT_HEADER_SIZE
+#define ECCX08_JWT_HEADER_SIZE 128
+#endif
+
+#ifndef ECCX08_JWT_TOKEN_SIZE
+#define ECCX08_JWT_TOKEN_SIZE 512
+#endif
+
+#ifndef ECCX08_JWT_MAX_CLAIMS
+#define ECCX08_JWT_MAX_CLAIMS 4
+#endif
+
+// ES256 JWT for one key slot. The encoded header is built once in
+// begin(), the claims are encoded and hashed straight into the token
+// buffer and a token is reused until less than renewBefore seconds
+// of its lifetime remain. Claim names and string values are not
+// copied, they must stay valid while the builder is in use. There
+// is no global instance (the token buffer is large), declare one
+// where it is needed.
+class ECCX08JWTClass {
+public:
+  ECCX08JWTClass();
+  virtual ~ECCX08JWTClass();
+
+  int begin(int slot, const char* kid = NULL);
+  void end();
+
+  void setAudience(const char* audience);
+  void setLifetime(unsigned long lifetime);
+  void setRenewBefore(unsigned long renewBefore);
+
+  int addClaim(const char* name, const char* value);
+  int addClaim(const char* name, long value);
+  void clearClaims();
+
+  const char* token(unsigned long now);
+  unsigned long expiry();
+  void invalidate();
+
+private:
+  int build(unsigned long now);
+  void printClaims(Print& out, unsigned long issuedAt, unsigned long expiry);
+  void printString(Print& out, const char* s);
+
+private:
+  int _slot;
+
+  char _header[ECCX08_JWT_HEADER_SIZE];
+  int _headerLength;
+
+  const char* _audience;
+  unsigned long _lifetime;
+  unsigned long _renewBefore;
+
+  struct {
+    const char* name;
+    const char* stringValue;
+    long numberValue;
+  } _claims[ECCX08_JWT_MAX_CLAIMS];
+  int _claimCount;
+
+  char _token[ECCX08_JWT_TOKEN_SIZE];
+  bool _tokenValid;
+  unsigned long _issuedAt;
+  unsigned long _expiry;
+};
+
 #endif
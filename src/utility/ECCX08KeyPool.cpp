@@ -0,0 +1,174 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "ECCX08.h"
+
+#include "ECCX08KeyPool.h"
+
+ECCX08KeyPoolClass::ECCX08KeyPoolClass() :
+  _count(0)
+{
+}
+
+ECCX08KeyPoolClass::~ECCX08KeyPoolClass()
+{
+}
+
+/** \brief Assigns spare key slots to the ephemeral key pool.
+ *
+ * The slots must be configured for ECC private keys that can be
+ * regenerated with GenKey. Their content is overwritten by the pool.
+ *
+ * \param[in] slots             Key slots owned by the pool
+ * \param[in] count             Number of slots, at most
+ *                              ECCX08_KEY_POOL_SIZE
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08KeyPoolClass::begin(const int slots[], int count)
+{
+  if (count < 1 || count > ECCX08_KEY_POOL_SIZE) {
+    return 0;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (slots[i] < 0 || slots[i] > 15) {
+      return 0;
+    }
+
+    _keys[i].slot = slots[i];
+    _keys[i].state = KEY_EMPTY;
+  }
+
+  _count = count;
+
+  return 1;
+}
+
+void ECCX08KeyPoolClass::end()
+{
+  for (int i = 0; i < _count; i++) {
+    memset(_keys[i].publicKey, 0x00, sizeof(_keys[i].publicKey));
+  }
+
+  _count = 0;
+}
+
+/** \brief Refills the pool, call while the chip is otherwise idle.
+ *
+ * At most one key pair is generated per call, so the time spent
+ * in here is bounded by a single GenKey command (about 115 ms).
+ *
+ * \return 1 if a key pair was generated, otherwise 0.
+ */
+int ECCX08KeyPoolClass::poll()
+{
+  for (int i = 0; i < _count; i++) {
+    if (_keys[i].state == KEY_EMPTY) {
+      return generate(i);
+    }
+  }
+
+  return 0;
+}
+
+int ECCX08KeyPoolClass::available()
+{
+  int ready = 0;
+
+  for (int i = 0; i < _count; i++) {
+    if (_keys[i].state == KEY_READY) {
+      ready++;
+    }
+  }
+
+  return ready;
+}
+
+/** \brief Hands out a pre-generated ephemeral key pair.
+ *
+ * If the pool has run dry a key pair is generated on demand.
+ * The returned slot is reserved until release() is called,
+ * after which it is regenerated by poll().
+ *
+ * \param[out] publicKey        Public key of the key pair
+ *                              (64 bytes)
+ *
+ * \return the key slot on success, otherwise -1.
+ */
+int ECCX08KeyPoolClass::acquire(byte publicKey[])
+{
+  int index = -1;
+
+  for (int i = 0; i < _count; i++) {
+    if (_keys[i].state == KEY_READY) {
+      index = i;
+      break;
+    }
+  }
+
+  if (index < 0) {
+    for (int i = 0; i < _count; i++) {
+      if (_keys[i].state == KEY_EMPTY) {
+        index = i;
+        break;
+      }
+    }
+
+    if (index < 0 || !generate(index)) {
+      return -1;
+    }
+  }
+
+  _keys[index].state = KEY_IN_USE;
+  memcpy(publicKey, _keys[index].publicKey, 64);
+
+  return _keys[index].slot;
+}
+
+/** \brief Returns a used key slot to the pool.
+ *
+ * The private key in the slot is treated as spent and
+ * is replaced by a fresh one on a following poll().
+ *
+ * \param[in] slot              Slot returned by acquire()
+ */
+void ECCX08KeyPoolClass::release(int slot)
+{
+  for (int i = 0; i < _count; i++) {
+    if (_keys[i].slot == slot && _keys[i].state == KEY_IN_USE) {
+      _keys[i].state = KEY_EMPTY;
+      memset(_keys[i].publicKey, 0x00, sizeof(_keys[i].publicKey));
+    }
+  }
+}
+
+int ECCX08KeyPoolClass::generate(int index)
+{
+  if (!ECCX08.generatePrivateKey(_keys[index].slot, _keys[index].publicKey)) {
+    return 0;
+  }
+
+  _keys[index].state = KEY_READY;
+
+  return 1;
+}
+
+ECCX08KeyPoolClass ECCX08KeyPool;
@@ -0,0 +1,74 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef _ECCX08_KEY_POOL_H_
+#define _ECCX08_KEY_POOL_H_
+
+#include <Arduino.h>
+
+#ifndef ECCX08_KEY_POOL_SIZE
+#ifdef __AVR__
+#define ECCX08_KEY_POOL_SIZE 2
+#else
+#define ECCX08_KEY_POOL_SIZE 4
+#endif
+#endif
+
+// Ephemeral ECDH key pairs kept in spare private key slots. Keys
+// live in slots only, a GenKey into TempKey would be clobbered by the
+// next Nonce or SHA command. Every refill is a GenKey, which writes the
+// slot's EEPROM: one write per handshake, against an endurance of about
+// 400,000 writes per slot, spread over the pool's slots.
+class ECCX08KeyPoolClass {
+public:
+  ECCX08KeyPoolClass();
+  virtual ~ECCX08KeyPoolClass();
+
+  int begin(const int slots[], int count);
+  void end();
+
+  int poll();
+  int available();
+
+  int acquire(byte publicKey[]);
+  void release(int slot);
+
+private:
+  int generate(int index);
+
+private:
+  enum {
+    KEY_EMPTY,
+    KEY_READY,
+    KEY_IN_USE
+  };
+
+  struct {
+    int slot;
+    int state;
+    byte publicKey[64];
+  } _keys[ECCX08_KEY_POOL_SIZE];
+
+  int _count;
+};
+
+extern ECCX08KeyPoolClass ECCX08KeyPool;
+
+#endif
@@ -0,0 +1,100 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "ECCX08.h"
+
+#include "ECCX08SHA256.h"
+
+ECCX08SHA256Class::ECCX08SHA256Class() :
+  _length(0),
+  _error(true)
+{
+}
+
+ECCX08SHA256Class::~ECCX08SHA256Class()
+{
+}
+
+/** \brief Starts a new hash, the chip has a single SHA-256
+ *   context so no other SHA or HMAC operation may run until end().
+ *
+ * \return 1 on success, otherwise 0.
+ */
+int ECCX08SHA256Class::begin()
+{
+  _length = 0;
+  _error = !ECCX08.beginSHA256();
+
+  return !_error;
+}
+
+/** \brief Finishes the hash.
+ *
+ * \param[out] result            SHA-256 digest (32 bytes)
+ *
+ * \return 1 on success, 0 if any part failed to hash.
+ */
+int ECCX08SHA256Class::end(byte result[])
+{
+  if (_error) {
+    return 0;
+  }
+
+  _error = true;
+
+  return ECCX08.endSHA256(_buffer, _length, result);
+}
+
+size_t ECCX08SHA256Class::write(uint8_t b)
+{
+  return write(&b, 1);
+}
+
+size_t ECCX08SHA256Class::write(const uint8_t *buffer, size_t size)
+{
+  if (_error) {
+    return 0;
+  }
+
+  for (size_t i = 0; i < size; ) {
+    size_t chunk = 64 - _length;
+
+    if (chunk > size - i) {
+      chunk = size - i;
+    }
+
+    memcpy(&_buffer[_length], &buffer[i], chunk);
+    _length += chunk;
+    i += chunk;
+
+    // full blocks are sent right away, the final
+    // command only takes the last 0 to 63 bytes
+    if (_length == 64) {
+      if (!ECCX08.updateSHA256(_buffer)) {
+        _error = true;
+        return 0;
+      }
+      _length = 0;
+    }
+  }
+
+  return size;
+}
+
+ECCX08SHA256Class ECCX08SHA256;
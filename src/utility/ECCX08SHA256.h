@@ -0,0 +1,48 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _ECCX08_SHA256_H_
+#define _ECCX08_SHA256_H_
+
+#include <Arduino.h>
+
+// Streams data into the chip's SHA-256 engine, 64 bytes per
+// command, so anything that can print to a Print can be hashed
+// without building it in RAM first.
+class ECCX08SHA256Class : public Print {
+public:
+  ECCX08SHA256Class();
+  virtual ~ECCX08SHA256Class();
+
+  int begin();
+  int end(byte result[]);
+
+  virtual size_t write(uint8_t b);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+
+private:
+  byte _buffer[64];
+  int _length;
+  bool _error;
+};
+
+extern ECCX08SHA256Class ECCX08SHA256;
+
+#endif
@@ -23,6 +23,7 @@ extern "C" {
   #include "sha1.h"
 }
 #include "ASN1Utils.h"
+#include "ECCX08SHA256.h"
 #include "PEMUtils.h"
 
 #include "ECCX08SelfSignedCert.h"
@@ -88,6 +89,15 @@ String ECCX08SelfSignedCertClass::endStorage()
   return PEMUtils.base64Encode(_bytes, _length, "-----BEGIN CERTIFICATE-----\n", "\n-----END CERTIFICATE-----\n");
 }
 
+int ECCX08SelfSignedCertClass::endStorage(Print& out)
+{
+  if (!buildCert(true)) {
+    return 0;
+  }
+
+  return PEMUtils.base64Encode(_bytes, _length, "-----BEGIN CERTIFICATE-----\n", "\n-----END CERTIFICATE-----\n", out);
+}
+
 int ECCX08SelfSignedCertClass::beginReconstruction(int keySlot, int dateAndSignatureSlot)
 {
   if (keySlot < 0 || keySlot > 8) {
@@ -228,38 +238,50 @@ int ECCX08SelfSignedCertClass::buildCert(bool buildSignature)
     return 0;
   }
 
-  int certInfoLen = certInfoLength();
-  int certInfoHeaderLen = ASN1Utils.sequenceHeaderLength(certInfoLen);
+  // issuer and subject are the same name, everything else
+  // (including all headers) fits in 320 bytes
+  int certSize = 320 + _serialNumberLength +
+                 2 * ASN1Utils.issuerOrSubjectLength(_countryName,
+                                                     _stateProvinceName,
+                                                     _localityName,
+                                                     _organizationName,
+                                                     _organizationalUnitName,
+                                                     _commonName);
+
+  _bytes = (byte*)realloc(_bytes, certSize);
+
+  if (!_bytes) {
+    _length = 0;
+    return 0;
+  }
+
+  ASN1Writer out(_bytes, certSize);
 
-  uint8_t certInfo[certInfoLen + certInfoHeaderLen];
+  out.begin(ASN1_SEQUENCE);
+
+  int certInfoStart = out.length();
+  appendCertInfo(publicKey, out);
+
+  if (out.overflow()) {
+    return 0;
+  }
 
-  appendCertInfo(publicKey, certInfo, certInfoLen);
-  
   if (buildSignature) {
+    uint8_t* certInfo = &_bytes[certInfoStart];
+    int certInfoLen = out.length() - certInfoStart;
+
     byte certInfoSha256[64];
 
     memset(certInfoSha256, 0x00, sizeof(certInfoSha256));
 
-    if (!ECCX08.beginSHA256()) {
+    if (!ECCX08SHA256.begin()) {
       return 0;
     }
 
-    for (int i = 0; i < (certInfoHeaderLen + certInfoLen); i += 64) {
-      int chunkLength = (certInfoHeaderLen + certInfoLen) - i;
-
-      if (chunkLength > 64) {
-        chunkLength = 64;
-      }
-
-      if (chunkLength == 64) {
-        if (!ECCX08.updateSHA256(&certInfo[i])) {
-          return 0;
-        }
-      } else {
-        if (!ECCX08.endSHA256(&certInfo[i], chunkLength, certInfoSha256)) {
-          return 0;
-        }
-      }
+    ECCX08SHA256.write(certInfo, certInfoLen);
+
+    if (!ECCX08SHA256.end(certInfoSha256)) {
+      return 0;
     }
 
     if (!ECCX08.ecSign(_keySlot, certInfoSha256, _temp)) {
@@ -271,77 +293,21 @@ int ECCX08SelfSignedCertClass::buildCert(bool buildSignature)
     }
   }
 
-  int signatureLen = ASN1Utils.signatureLength(_temp);
-
-  int certDataLen = certInfoLen + certInfoHeaderLen + signatureLen;
-  int certDataHeaderLen = ASN1Utils.sequenceHeaderLength(certDataLen);
-
-  _length = certDataLen + certDataHeaderLen;
-  _bytes = (byte*)realloc(_bytes, _length);
+  // signature
+  ASN1Utils.appendSignature(_temp, out);
 
-  if (!_bytes) {
-    _length = 0;
+  if (!out.end()) {
     return 0;
   }
 
-  uint8_t* out = _bytes;
-
-  out += ASN1Utils.appendSequenceHeader(certDataLen, out);
-
-  memcpy(out, certInfo, certInfoHeaderLen + certInfoLen);
-  out += (certInfoHeaderLen + certInfoLen);
-
-  // signature
-  out += ASN1Utils.appendSignature(_temp, out);
+  _length = out.length();
 
   return 1;
 }
 
-int ECCX08SelfSignedCertClass::certInfoLength()
-{
-  struct CompressedCert* compressedCert = (struct CompressedCert*)_temp;
-
-  int year = (compressedCert->dates.year + 2000);
-  int expireYears = compressedCert->dates.expires;
-
-  int datesSize = 30;
-
-  if (year > 2049) {
-    // two more bytes for GeneralizedTime
-    datesSize += 2;
-  }
-
-  if ((year + expireYears) > 2049) {
-    // two more bytes for GeneralizedTime
-    datesSize += 2;
-  }
-
-  int serialNumberLen = ASN1Utils.serialNumberLength(_serialNumber, _serialNumberLength);
-
-  int issuerAndSubjectLen = ASN1Utils.issuerOrSubjectLength(_countryName,
-                                                            _stateProvinceName,
-                                                            _localityName,
-                                                            _organizationName,
-                                                            _organizationalUnitName,
-                                                            _commonName);
-
-  int issuerAndSubjectHeaderLen = ASN1Utils.sequenceHeaderLength(issuerAndSubjectLen);
-
-
-  int publicKeyLen = ASN1Utils.publicKeyLength();
-  
-
-  int certInfoLen = 5 + serialNumberLen + 12 + 
-                    2 * (issuerAndSubjectHeaderLen + issuerAndSubjectLen) + 
-                    (datesSize + 2) + publicKeyLen + 4;
-
-  return certInfoLen;
-}
-
-void ECCX08SelfSignedCertClass::appendCertInfo(uint8_t publicKey[], uint8_t buffer[], int length)
+void ECCX08SelfSignedCertClass::appendCertInfo(uint8_t publicKey[], ASN1Writer& out)
 {
   struct CompressedCert* compressedCert = (struct CompressedCert*)_temp;
-  uint8_t* out = buffer;
 
   // dates
   int year = (compressedCert->dates.year + 2000);
@@ -350,60 +316,45 @@ void ECCX08SelfSignedCertClass::appendCertInfo(uint8_t publicKey[], uint8_t buff
   int hour = compressedCert->dates.hour;
   int expireYears = compressedCert->dates.expires;
 
-  out += ASN1Utils.appendSequenceHeader(length, out);
+  out.begin(ASN1_SEQUENCE);
 
   // version
-  *out++ = 0xA0;
-  *out++ = 0x03;
-  *out++ = 0x02;
-  *out++ = 0x01;
-  *out++ = 0x02;
+  const byte version[] = { 0x02, 0x01, 0x02 };
+  out.append(0xA0, version, sizeof(version));
 
   // serial number
-  out += ASN1Utils.appendSerialNumber(_serialNumber, _serialNumberLength, out);
+  ASN1Utils.appendSerialNumber(_serialNumber, _serialNumberLength, out);
 
-  out += ASN1Utils.appendEcdsaWithSHA256(out);
+  ASN1Utils.appendEcdsaWithSHA256(out);
 
   // issuer
-  int issuerAndSubjectLen = ASN1Utils.issuerOrSubjectLength(_countryName,
-                                                            _stateProvinceName,
-                                                            _localityName,
-                                                            _organizationName,
-                                                            _organizationalUnitName,
-                                                            _commonName);
-
-  out += ASN1Utils.appendSequenceHeader(issuerAndSubjectLen, out);
+  int issuerStart = out.length();
   ASN1Utils.appendIssuerOrSubject(_countryName,
                                   _stateProvinceName,
                                   _localityName,
                                   _organizationName,
                                   _organizationalUnitName,
                                   _commonName, out);
-  out += issuerAndSubjectLen;
+  int issuerLen = out.length() - issuerStart;
 
-  *out++ = ASN1_SEQUENCE;
-  *out++ = 30 + ((year > 2049) ? 2 : 0) + (((year + expireYears) > 2049) ? 2 : 0);
-  out += ASN1Utils.appendDate(year, month, day, hour, 0, 0, out);
-  out += ASN1Utils.appendDate(year + expireYears, month, day, hour, 0, 0, out);
+  out.begin(ASN1_SEQUENCE);
+  ASN1Utils.appendDate(year, month, day, hour, 0, 0, out);
+  ASN1Utils.appendDate(year + expireYears, month, day, hour, 0, 0, out);
+  out.end();
 
-  // subject
-  out += ASN1Utils.appendSequenceHeader(issuerAndSubjectLen, out);
-  ASN1Utils.appendIssuerOrSubject(_countryName,
-                                  _stateProvinceName,
-                                  _localityName,
-                                  _organizationName,
-                                  _organizationalUnitName,
-                                  _commonName, out);
-  out += issuerAndSubjectLen;
+  // subject, same as the issuer
+  out.append(&out.data()[issuerStart], issuerLen);
 
   // public key
-  out += ASN1Utils.appendPublicKey(publicKey, out);
+  ASN1Utils.appendPublicKey(publicKey, out);
 
   // null sequence
-  *out++ = 0xA3;
-  *out++ = 0x02;
-  *out++ = 0x30;
-  *out++ = 0x00;
+  out.begin(0xA3);
+  out.begin(ASN1_SEQUENCE);
+  out.end();
+  out.end();
+
+  out.end();
 }
 
 ECCX08SelfSignedCertClass ECCX08SelfSignedCert;
@@ -22,6 +22,8 @@
 
 #include <Arduino.h>
 
+class ASN1Writer;
+
 class ECCX08SelfSignedCertClass {
 public:
   ECCX08SelfSignedCertClass();
@@ -29,6 +31,7 @@ public:
 
   int beginStorage(int keySlot, int dateAndSignatureSlot, bool newKey);
   String endStorage();
+  int endStorage(Print& out);
 
   int beginReconstruction(int keySlot, int dateAndSignatureSlot);
   int endReconstruction();
@@ -66,8 +69,7 @@ public:
 private:
   int buildCert(bool buildSignature);
 
-  int certInfoLength();
-  void appendCertInfo(uint8_t publicKey[], uint8_t buffer[], int length);
+  void appendCertInfo(uint8_t publicKey[], ASN1Writer& out);
 
 private:
   int _keySlot;
@@ -17,86 +17,122 @@
   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
+#include "ASN1Utils.h"
 #include "PEMUtils.h"
-#include "b64.h"
 
 String PEMUtilsClass::base64Encode(const byte in[], unsigned int length, const char* prefix, const char* suffix)
 {
-  static const char* CODES = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
-
-  int b;
   String out;
 
   int reserveLength = 4 * ((length + 2) / 3) + ((length / 3 * 4) / 76) + strlen(prefix) + strlen(suffix);
   out.reserve(reserveLength);
 
-  if (prefix) {
-    out += prefix;
-  }
-  
-  for (unsigned int i = 0; i < length; i += 3) {
-    if (i > 0 && (i / 3 * 4) % 76 == 0) { 
-      out += '\n'; 
-    }
-
-    b = (in[i] & 0xFC) >> 2;
-    out += CODES[b];
-
-    b = (in[i] & 0x03) << 4;
-    if (i + 1 < length) {
-      b |= (in[i + 1] & 0xF0) >> 4;
-      out += CODES[b];
-      b = (in[i + 1] & 0x0F) << 2;
-      if (i + 2 < length) {
-         b |= (in[i + 2] & 0xC0) >> 6;
-         out += CODES[b];
-         b = in[i + 2] & 0x3F;
-         out += CODES[b];
-      } else {
-        out += CODES[b];
-        out += '=';
-      }
-    } else {
-      out += CODES[b];
-      out += "==";
-    }
+  StringPrint print(out);
+
+  base64Encode(in, length, prefix, suffix, print);
+
+  return out;
+}
+
+int PEMUtilsClass::base64Encode(const byte in[], unsigned int length, const char* prefix, const char* suffix, Print& out, int lineLength)
+{
+  Base64Encoder encoder(out, lineLength);
+
+  if (prefix && out.print(prefix) != strlen(prefix)) {
+    return 0;
+  }
+
+  encoder.write(in, length);
+
+  if (!encoder.end()) {
+    return 0;
   }
 
-  if (suffix) {
-    out += suffix;
+  if (suffix && out.print(suffix) != strlen(suffix)) {
+    return 0;
   }
 
+  return 1;
+}
+
+int PEMUtilsClass::base64Encode(const byte in[], unsigned int length, const char* prefix, const char* suffix, char out[], int size, int lineLength)
+{
+  BufferPrint buffer(out, size);
+
+  base64Encode(in, length, prefix, suffix, buffer, lineLength);
+
+  // room for the terminator
+  if (buffer.length() >= size) {
+    return -1;
+  }
+  out[buffer.length()] = '\0';
+
+  return buffer.length();
+}
+
+String PEMUtilsClass::base64urlEncode(const byte in[], unsigned int length)
+{
+  String out;
+
+  out.reserve((4 * length + 2) / 3);
+
+  StringPrint print(out);
+
+  base64urlEncode(in, length, print);
+
   return out;
 }
 
-int PEMUtilsClass::base64Decode(const String in, byte out[])
+int PEMUtilsClass::base64urlEncode(const byte in[], unsigned int length, Print& out)
 {
-  String inBase64 = String(in);
-  inBase64.trim();
-  // check PEM encoded
-  if ( inBase64.startsWith("-----BEGIN ") && inBase64.endsWith("-----")) {
-      int endLine1Char = inBase64.indexOf('\n');
-      if (endLine1Char < 0) {
-          return -2;
-      }
-      int endLastLineChar = inBase64.lastIndexOf('\n');
-      if (endLastLineChar < 0) {
-          return -3;
-      }
-      inBase64 = inBase64.substring(endLine1Char, endLastLineChar);
-      for (int i=inBase64.indexOf('\n'); i != -1; i=inBase64.indexOf('\n')) {
-        inBase64.remove(i,1);
-      }
+  Base64Encoder encoder(out, 0, true);
+
+  encoder.write(in, length);
+
+  return encoder.end();
+}
+
+int PEMUtilsClass::base64Decode(const String& in, byte out[])
+{
+  // no size given, allow for the largest possible output
+  return base64Decode(in.c_str(), in.length(), out, in.length() / 4 * 3 + 3);
+}
+
+int PEMUtilsClass::base64Decode(const char in[], size_t length, byte out[], int size)
+{
+  Base64Decoder decoder(out, size);
+
+  decoder.write((const uint8_t*)in, length);
+
+  return decoder.end();
+}
+
+int PEMUtilsClass::base64Decode(Stream& in, byte out[], int size)
+{
+  Base64Decoder decoder(out, size);
+  char c;
+
+  // one character at a time, so nothing after the END line is consumed
+  while (!decoder.done() && in.readBytes(&c, 1) == 1) {
+    decoder.write(c);
   }
 
-  int len = decode_base64((unsigned char*)inBase64.c_str(), out); 
-  return len;
+  return decoder.end();
+}
+
+int PEMUtilsClass::base64urlDecode(const char in[], size_t length, byte out[], int size)
+{
+  Base64Decoder decoder(out, size, true);
+
+  decoder.write((const uint8_t*)in, length);
+
+  return decoder.end();
 }
 
 int PEMUtilsClass::xyFromPubKeyPEM(const String publicKeyPem, byte xy[64])
 {
     byte derBytes[256];
-    int derLen = PEMUtils.base64Decode(publicKeyPem, derBytes);
+    int derLen = PEMUtils.base64Decode(publicKeyPem.c_str(), publicKeyPem.length(), derBytes, sizeof(derBytes));
     if (derLen < 1) {
         return -4;
     }
@@ -104,17 +140,374 @@ int PEMUtilsClass::xyFromPubKeyPEM(const String publicKeyPem, byte xy[64])
         return -5;
     }
 
-    int j = derLen-64;
-    if (derBytes[j-1] != 0x04) { // ASN.1 uncompressed public key
+    ASN1Reader der(derBytes, derLen);
+    ASN1Element subjectPublicKeyInfo;
+
+    // SubjectPublicKeyInfo with an uncompressed P-256 point
+    if (!der.next(ASN1_SEQUENCE, subjectPublicKeyInfo) ||
+        !ASN1Utils.parsePublicKey(subjectPublicKeyInfo, xy)) {
         return -6;
     }
 
-    // the public key X and Y values are the last 64 bytes
-    for (int i = 0; i < 64; i++) {
-        xy[i] = derBytes[j++];
+    return 0;
+}
+
+static const char* BASE64_CODES = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char* BASE64URL_CODES = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+Base64Encoder::Base64Encoder(Print& out, int lineLength, bool url) :
+  _out(&out),
+  _codes(url ? BASE64URL_CODES : BASE64_CODES),
+  _url(url),
+  _lineLength(lineLength),
+  _column(0),
+  _error(false),
+  _inLength(0),
+  _chunkLength(0)
+{
+}
+
+Base64Encoder::~Base64Encoder()
+{
+}
+
+size_t Base64Encoder::write(uint8_t b)
+{
+  return write(&b, 1);
+}
+
+size_t Base64Encoder::write(const uint8_t *buffer, size_t size)
+{
+  if (_error) {
+    return 0;
+  }
+
+  size_t i = 0;
+
+  // complete a group left over from the previous write
+  if (_inLength > 0) {
+    while (_inLength < 3 && i < size) {
+      _in[_inLength++] = buffer[i++];
+    }
+
+    if (_inLength < 3) {
+      return size;
     }
 
+    encode(_in);
+    _inLength = 0;
+  }
+
+  for (; i + 3 <= size; i += 3) {
+    encode(&buffer[i]);
+  }
+
+  while (i < size) {
+    _in[_inLength++] = buffer[i++];
+  }
+
+  return _error ? 0 : size;
+}
+
+int Base64Encoder::end()
+{
+  if (_inLength == 1) {
+    put(_codes[_in[0] >> 2]);
+    put(_codes[(_in[0] & 0x03) << 4]);
+
+    if (!_url) {
+      put('=');
+      put('=');
+    }
+  } else if (_inLength == 2) {
+    put(_codes[_in[0] >> 2]);
+    put(_codes[((_in[0] & 0x03) << 4) | (_in[1] >> 4)]);
+    put(_codes[(_in[1] & 0x0f) << 2]);
+
+    if (!_url) {
+      put('=');
+    }
+  }
+  _inLength = 0;
+
+  return writeChunk();
+}
+
+void Base64Encoder::encode(const uint8_t in[])
+{
+  // whole group fits on the line and in the chunk, skip the per character checks
+  if ((_lineLength == 0 || _column + 4 <= _lineLength) && _chunkLength + 4 <= (int)sizeof(_chunk)) {
+    char* out = &_chunk[_chunkLength];
+
+    out[0] = _codes[in[0] >> 2];
+    out[1] = _codes[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+    out[2] = _codes[((in[1] & 0x0f) << 2) | (in[2] >> 6)];
+    out[3] = _codes[in[2] & 0x3f];
+
+    _chunkLength += 4;
+    _column += 4;
+  } else {
+    put(_codes[in[0] >> 2]);
+    put(_codes[((in[0] & 0x03) << 4) | (in[1] >> 4)]);
+    put(_codes[((in[1] & 0x0f) << 2) | (in[2] >> 6)]);
+    put(_codes[in[2] & 0x3f]);
+  }
+}
+
+void Base64Encoder::put(char c)
+{
+  // the newline is only written before the next character,
+  // so there is none after the last line
+  if (_lineLength > 0 && _column == _lineLength) {
+    _column = 0;
+    put('\n');
+  }
+
+  if (_chunkLength == sizeof(_chunk)) {
+    writeChunk();
+  }
+
+  _chunk[_chunkLength++] = c;
+
+  if (c != '\n') {
+    _column++;
+  }
+}
+
+int Base64Encoder::writeChunk()
+{
+  if (_chunkLength > 0 && !_error) {
+    if (_out->write((const uint8_t*)_chunk, _chunkLength) != (size_t)_chunkLength) {
+      _error = true;
+    }
+  }
+  _chunkLength = 0;
+
+  return !_error;
+}
+
+// 0x00 - 0x3f: value, 0x40: whitespace, 0x41: '=', 0x42: '-', 0x43: '_', 0xff: invalid
+static const uint8_t BASE64_DECODE[256] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x40, 0x40, 0xff, 0xff, 0x40, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0x40, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0x42, 0xff, 0x3f,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0x41, 0xff, 0xff,
+  0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+  0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0x43,
+  0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+#define BASE64_WHITESPACE 0x40
+#define BASE64_PAD        0x41
+#define BASE64_ARMOR      0x42
+#define BASE64_URL_63     0x43
+
+Base64Decoder::Base64Decoder(byte out[], int size, bool url) :
+  _out(out),
+  _size(size),
+  _length(0),
+  _url(url),
+  _state(STATE_DATA),
+  _overflow(false),
+  _dataSeen(false),
+  _bits(0),
+  _count(0)
+{
+}
+
+Base64Decoder::~Base64Decoder()
+{
+}
+
+size_t Base64Decoder::write(uint8_t c)
+{
+  if (done()) {
     return 0;
+  }
+
+  if (_state == STATE_ARMOR) {
+    if (c == '\n') {
+      // an armor line after the data is the END line
+      _state = _dataSeen ? STATE_DONE : STATE_DATA;
+    }
+
+    return 1;
+  }
+
+  uint8_t value = BASE64_DECODE[c];
+
+  if (_url) {
+    if (value == BASE64_ARMOR) {
+      value = 62;
+    } else if (value == BASE64_URL_63) {
+      value = 63;
+    } else if (c == '+' || c == '/') {
+      value = 0xff;
+    }
+  } else if (value == BASE64_URL_63) {
+    value = 0xff;
+  }
+
+  if (value < 64) {
+    if (_state == STATE_PADDING) {
+      _state = STATE_ERROR;
+      return 0;
+    }
+
+    _bits = (_bits << 6) | value;
+    _count++;
+    _dataSeen = true;
+
+    // every character after the first of a quantum completes a byte
+    if (_count > 1) {
+      if (_length == _size) {
+        _overflow = true;
+        _state = STATE_ERROR;
+        return 0;
+      }
+
+      _out[_length++] = _bits >> (2 * (4 - _count));
+
+      if (_count == 4) {
+        _bits = 0;
+        _count = 0;
+      }
+    }
+  } else if (value == BASE64_PAD) {
+    if (_count < 2) {
+      _state = STATE_ERROR;
+      return 0;
+    }
+
+    _state = STATE_PADDING;
+
+    if (++_count == 4) {
+      _bits = 0;
+      _count = 0;
+    }
+  } else if (value == BASE64_ARMOR) {
+    _state = STATE_ARMOR;
+  } else if (value != BASE64_WHITESPACE) {
+    _state = STATE_ERROR;
+    return 0;
+  }
+
+  return 1;
+}
+
+size_t Base64Decoder::write(const uint8_t *buffer, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++) {
+    if (!write(buffer[i])) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+bool Base64Decoder::done()
+{
+  return (_state == STATE_DONE || _state == STATE_ERROR);
+}
+
+int Base64Decoder::end()
+{
+  if (_state == STATE_ERROR) {
+    return _overflow ? -2 : -1;
+  }
+
+  // a single character does not make a byte
+  if (_count == 1) {
+    return -1;
+  }
+
+  return _length;
+}
+
+StringPrint::StringPrint(String& string) :
+  _string(&string)
+{
+}
+
+StringPrint::~StringPrint()
+{
+}
+
+size_t StringPrint::write(uint8_t b)
+{
+  *_string += (char)b;
+
+  return 1;
+}
+
+size_t StringPrint::write(const uint8_t *buffer, size_t size)
+{
+  char chunk[65];
+
+  for (size_t i = 0; i < size; i += 64) {
+    size_t chunkLength = size - i;
+
+    if (chunkLength > 64) {
+      chunkLength = 64;
+    }
+
+    memcpy(chunk, &buffer[i], chunkLength);
+    chunk[chunkLength] = '\0';
+
+    *_string += chunk;
+  }
+
+  return size;
+}
+
+BufferPrint::BufferPrint(char buffer[], int size) :
+  _buffer(buffer),
+  _size(size),
+  _length(0)
+{
+}
+
+BufferPrint::~BufferPrint()
+{
+}
+
+size_t BufferPrint::write(uint8_t b)
+{
+  if (_length < _size) {
+    _buffer[_length] = b;
+  }
+  _length++;
+
+  return 1;
+}
+
+size_t BufferPrint::write(const uint8_t *buffer, size_t size)
+{
+  if (_length < _size) {
+    int room = _size - _length;
+
+    memcpy(&_buffer[_length], buffer, (int)size < room ? size : room);
+  }
+  _length += size;
+
+  return size;
+}
+
+int BufferPrint::length()
+{
+  return _length;
 }
 
 PEMUtilsClass PEMUtils;
@@ -22,10 +22,124 @@
 
 #include <Arduino.h>
 
+// Stateful base64 encoder, everything written to it is encoded and
+// forwarded to the sink in small chunks, wrapping lines at lineLength
+// characters (0 for no wrapping). end() writes the final padding, url
+// selects the unpadded base64url alphabet of RFC 4648 section 5.
+class Base64Encoder : public Print {
+public:
+  Base64Encoder(Print& out, int lineLength = 76, bool url = false);
+  virtual ~Base64Encoder();
+
+  virtual size_t write(uint8_t b);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+
+  int end();
+
+private:
+  void encode(const uint8_t in[]);
+  void put(char c);
+  int writeChunk();
+
+private:
+  Print* _out;
+  const char* _codes;
+  bool _url;
+  int _lineLength;
+  int _column;
+  bool _error;
+
+  byte _in[3];
+  int _inLength;
+
+  char _chunk[64];
+  int _chunkLength;
+};
+
+// Stateful base64 decoder, text written to it is decoded straight into
+// the caller's buffer in a single pass. Whitespace and PEM armor lines
+// are skipped, input after the END armor line is not consumed so
+// bundles can be decoded one document at a time. end() returns the
+// decoded length, -1 for malformed input or -2 when out is too small.
+// With url set the base64url alphabet is expected and there is no armor.
+class Base64Decoder : public Print {
+public:
+  Base64Decoder(byte out[], int size, bool url = false);
+  virtual ~Base64Decoder();
+
+  virtual size_t write(uint8_t c);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+
+  bool done();
+  int end();
+
+private:
+  enum {
+    STATE_DATA,
+    STATE_ARMOR,
+    STATE_PADDING,
+    STATE_DONE,
+    STATE_ERROR
+  };
+
+  byte* _out;
+  int _size;
+  int _length;
+
+  bool _url;
+  uint8_t _state;
+  bool _overflow;
+  bool _dataSeen;
+  uint32_t _bits;
+  int _count;
+};
+
+// Appends everything written to it to a String, lets the
+// Print based encoders still produce String results
+class StringPrint : public Print {
+public:
+  StringPrint(String& string);
+  virtual ~StringPrint();
+
+  virtual size_t write(uint8_t b);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+
+private:
+  String* _string;
+};
+
+// Writes into caller memory, length() also counts what did not fit
+class BufferPrint : public Print {
+public:
+  BufferPrint(char buffer[], int size);
+  virtual ~BufferPrint();
+
+  virtual size_t write(uint8_t b);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  using Print::write;
+
+  int length();
+
+private:
+  char* _buffer;
+  int _size;
+  int _length;
+};
+
 class PEMUtilsClass {
 public:
    String base64Encode(const byte in[], unsigned int length, const char* prefix, const char* suffix);
-   int base64Decode(const String in, byte out[]);
+   int base64Encode(const byte in[], unsigned int length, const char* prefix, const char* suffix, Print& out, int lineLength = 76);
+   int base64Encode(const byte in[], unsigned int length, const char* prefix, const char* suffix, char out[], int size, int lineLength = 76);
+   String base64urlEncode(const byte in[], unsigned int length);
+   int base64urlEncode(const byte in[], unsigned int length, Print& out);
+   int base64Decode(const String& in, byte out[]);
+   int base64Decode(const char in[], size_t length, byte out[], int size);
+   int base64Decode(Stream& in, byte out[], int size);
+   int base64urlDecode(const char in[], size_t length, byte out[], int size);
    int xyFromPubKeyPEM(const String in, byte xy[64]);
 };
 
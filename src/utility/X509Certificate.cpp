@@ -0,0 +1,202 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "X509Certificate.h"
+
+X509Certificate::X509Certificate()
+{
+  clear();
+}
+
+X509Certificate::~X509Certificate()
+{
+}
+
+int X509Certificate::begin(const byte der[], int length)
+{
+  ASN1Reader top(der, length);
+  ASN1Element certificate;
+  ASN1Element innerSignatureAlgorithm;
+  ASN1Element validity;
+  ASN1Element element;
+
+  clear();
+
+  // Certificate ::= SEQUENCE { tbsCertificate, signatureAlgorithm, signatureValue }
+  if (!top.next(ASN1_SEQUENCE, certificate) || !top.atEnd()) {
+    return 0;
+  }
+
+  ASN1Reader cert(certificate);
+
+  if (!cert.next(ASN1_SEQUENCE, _tbsCertificate) ||
+      !cert.next(ASN1_SEQUENCE, _signatureAlgorithm) ||
+      !cert.next(ASN1_BIT_STRING, _signatureValue) ||
+      !cert.atEnd()) {
+    return 0;
+  }
+
+  ASN1Reader tbs(_tbsCertificate);
+
+  // version [0] EXPLICIT, v1 when absent
+  _version = 1;
+  if (tbs.peek() == 0xa0) {
+    if (!tbs.next(element)) {
+      return 0;
+    }
+
+    ASN1Reader versionReader(element);
+    ASN1Element versionValue;
+
+    if (!versionReader.next(ASN1_INTEGER, versionValue) || versionValue.length != 1) {
+      return 0;
+    }
+    _version = versionValue.value[0] + 1;
+  }
+
+  if (!tbs.next(ASN1_INTEGER, _serialNumber) ||
+      !tbs.next(ASN1_SEQUENCE, innerSignatureAlgorithm) ||
+      !tbs.next(ASN1_SEQUENCE, _issuer) ||
+      !tbs.next(ASN1_SEQUENCE, validity) ||
+      !tbs.next(ASN1_SEQUENCE, _subject) ||
+      !tbs.next(ASN1_SEQUENCE, _subjectPublicKeyInfo)) {
+    return 0;
+  }
+
+  // the signature algorithm is repeated inside the signed part
+  if (innerSignatureAlgorithm.totalLength() != _signatureAlgorithm.totalLength() ||
+      memcmp(innerSignatureAlgorithm.header, _signatureAlgorithm.header, _signatureAlgorithm.totalLength()) != 0) {
+    return 0;
+  }
+
+  ASN1Reader validityReader(validity);
+
+  if (!validityReader.next(_notBefore) || !validityReader.next(_notAfter) ||
+      !validityReader.atEnd()) {
+    return 0;
+  }
+
+  if ((_notBefore.tag != ASN1_UTC_TIME && _notBefore.tag != ASN1_GENERALIZED_TIME) ||
+      (_notAfter.tag != ASN1_UTC_TIME && _notAfter.tag != ASN1_GENERALIZED_TIME)) {
+    return 0;
+  }
+
+  // issuerUniqueID [1], subjectUniqueID [2], extensions [3]
+  while (tbs.next(element)) {
+    if (element.tag == 0xa3) {
+      ASN1Reader extensionsReader(element);
+
+      if (!extensionsReader.next(ASN1_SEQUENCE, _extensions)) {
+        return 0;
+      }
+    } else if (element.tag != 0x81 && element.tag != 0x82) {
+      return 0;
+    }
+  }
+
+  if (tbs.error()) {
+    return 0;
+  }
+
+  return 1;
+}
+
+bool X509Certificate::isEcdsaWithSHA256()
+{
+  static const byte ECDSA_WITH_SHA256[] = { 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x04, 0x03, 0x02 };
+
+  ASN1Reader algorithm(_signatureAlgorithm);
+  ASN1Element oid;
+
+  if (!algorithm.next(ASN1_OBJECT_IDENTIFIER, oid)) {
+    return false;
+  }
+
+  // the parameters must be absent
+  return (ASN1Utils.oidEquals(oid, ECDSA_WITH_SHA256, sizeof(ECDSA_WITH_SHA256)) && algorithm.atEnd());
+}
+
+int X509Certificate::publicKey(byte publicKey[])
+{
+  return ASN1Utils.parsePublicKey(_subjectPublicKeyInfo, publicKey);
+}
+
+int X509Certificate::signature(byte signature[])
+{
+  return ASN1Utils.parseSignature(_signatureValue, signature);
+}
+
+int X509Certificate::extension(const byte oid[], int oidLength, ASN1Element& value, bool* critical)
+{
+  ASN1Reader extensions(_extensions);
+  ASN1Element extension;
+
+  // Extension ::= SEQUENCE { extnID, critical BOOLEAN DEFAULT FALSE, extnValue OCTET STRING }
+  while (extensions.next(ASN1_SEQUENCE, extension)) {
+    ASN1Reader fields(extension);
+    ASN1Element id;
+    ASN1Element field;
+
+    if (!fields.next(ASN1_OBJECT_IDENTIFIER, id)) {
+      return 0;
+    }
+
+    if (!ASN1Utils.oidEquals(id, oid, oidLength)) {
+      continue;
+    }
+
+    bool isCritical = false;
+
+    if (fields.peek() == ASN1_BOOLEAN) {
+      if (!fields.next(field) || field.length != 1) {
+        return 0;
+      }
+      isCritical = (field.value[0] != 0x00);
+    }
+
+    if (!fields.next(ASN1_OCTET_STRING, value)) {
+      return 0;
+    }
+
+    if (critical) {
+      *critical = isCritical;
+    }
+
+    return 1;
+  }
+
+  return 0;
+}
+
+void X509Certificate::clear()
+{
+  static const ASN1Element EMPTY = { 0, NULL, NULL, 0 };
+
+  _version = 0;
+  _tbsCertificate = EMPTY;
+  _serialNumber = EMPTY;
+  _signatureAlgorithm = EMPTY;
+  _issuer = EMPTY;
+  _notBefore = EMPTY;
+  _notAfter = EMPTY;
+  _subject = EMPTY;
+  _subjectPublicKeyInfo = EMPTY;
+  _extensions = EMPTY;
+  _signatureValue = EMPTY;
+}
@@ -0,0 +1,71 @@
+/*
+  This file is part of the ArduinoECCX08 library.
+  Copyright (c) 2019 Arduino SA. All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _X509_CERTIFICATE_H_
+#define _X509_CERTIFICATE_H_
+
+#include <Arduino.h>
+
+#include "ASN1Utils.h"
+
+// Parses a DER encoded X.509 certificate in place, all fields
+// are views into the caller's buffer which must stay valid.
+class X509Certificate {
+public:
+  X509Certificate();
+  virtual ~X509Certificate();
+
+  int begin(const byte der[], int length);
+
+  const ASN1Element& tbsCertificate() { return _tbsCertificate; }
+  int version() { return _version; }
+  const ASN1Element& serialNumber() { return _serialNumber; }
+  const ASN1Element& signatureAlgorithm() { return _signatureAlgorithm; }
+  const ASN1Element& issuer() { return _issuer; }
+  const ASN1Element& notBefore() { return _notBefore; }
+  const ASN1Element& notAfter() { return _notAfter; }
+  const ASN1Element& subject() { return _subject; }
+  const ASN1Element& subjectPublicKeyInfo() { return _subjectPublicKeyInfo; }
+  const ASN1Element& extensions() { return _extensions; }
+  const ASN1Element& signatureValue() { return _signatureValue; }
+
+  bool isEcdsaWithSHA256();
+  int publicKey(byte publicKey[]);
+  int signature(byte signature[]);
+  int extension(const byte oid[], int oidLength, ASN1Element& value, bool* critical = NULL);
+
+private:
+  void clear();
+
+private:
+  int _version;
+
+  ASN1Element _tbsCertificate;
+  ASN1Element _serialNumber;
+  ASN1Element _signatureAlgorithm;
+  ASN1Element _issuer;
+  ASN1Element _notBefore;
+  ASN1Element _notAfter;
+  ASN1Element _subject;
+  ASN1Element _subjectPublicKeyInfo;
+  ASN1Element _extensions;
+  ASN1Element _signatureValue;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef AES128_H
+#define AES128_H
+
+/*
+   AES-128 block encryption in software, see FIPS 197.
+
+   Used for bulk AES-GCM with a session key derived on the
+   chip, the long-term keys never leave the ATECCX08.
+ */
+
+#include "stdint.h"
+
+typedef struct
+{
+    uint32_t rk[44];
+} AES128_CTX;
+
+void AES128Init(
+    AES128_CTX * context,
+    const unsigned char key[16]
+    );
+
+void AES128Encrypt(
+    const AES128_CTX * context,
+    const unsigned char in[16],
+    unsigned char out[16]
+    );
+
+void AES128Clear(
+    AES128_CTX * context
+    );
+
+#endif /* AES128_H */
@@ -0,0 +1,117 @@
+/*
+   GHASH multiplication in GF(2^128) for AES-GCM,
+   see NIST Special Publication 800-38D 6.3 and 6.4.
+
+   Shoup's 4-bit table method: H is expanded into the 16
+   multiples H * i (i being a 4-bit polynomial), the product
+   X * H is then accumulated one nibble of X at a time with
+   a 4-bit shift and a table based reduction.
+ */
+
+#include "ghash.h"
+
+/* Reduction of the 4 bits shifted out, x^128 = x^7 + x^2 + x + 1 */
+static const uint16_t last4[16] =
+{
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static uint64_t load64(const unsigned char *p)
+{
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+           ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+           ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+           ((uint64_t)p[6] << 8) | ((uint64_t)p[7]);
+}
+
+static void store64(unsigned char *p, uint64_t v)
+{
+    int i;
+
+    for (i = 7; i >= 0; i--)
+    {
+        p[i] = (unsigned char)(v & 0xff);
+        v >>= 8;
+    }
+}
+
+void GHASHInit(
+    GHASH_CTX * context,
+    const unsigned char H[16]
+)
+{
+    int i, j;
+    uint64_t vh, vl;
+
+    vh = load64(H);
+    vl = load64(H + 8);
+
+    /* the bit order of GCM is reversed, index 8 holds H itself */
+    context->HL[8] = vl;
+    context->HH[8] = vh;
+    context->HL[0] = 0;
+    context->HH[0] = 0;
+
+    for (i = 4; i > 0; i >>= 1)
+    {
+        uint64_t T = (vl & 1) ? 0xe100000000000000ULL : 0;
+
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ T;
+
+        context->HL[i] = vl;
+        context->HH[i] = vh;
+    }
+
+    for (i = 2; i <= 8; i *= 2)
+    {
+        vh = context->HH[i];
+        vl = context->HL[i];
+
+        for (j = 1; j < i; j++)
+        {
+            context->HH[i + j] = vh ^ context->HH[j];
+            context->HL[i + j] = vl ^ context->HL[j];
+        }
+    }
+}
+
+void GHASHMultiply(
+    const GHASH_CTX * context,
+    unsigned char X[16]
+)
+{
+    int i;
+    unsigned char lo, hi, rem;
+    uint64_t zh, zl;
+
+    lo = X[15] & 0x0f;
+
+    zh = context->HH[lo];
+    zl = context->HL[lo];
+
+    for (i = 15; i >= 0; i--)
+    {
+        lo = X[i] & 0x0f;
+        hi = (X[i] >> 4) & 0x0f;
+
+        if (i != 15)
+        {
+            rem = (unsigned char)(zl & 0x0f);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ ((uint64_t)last4[rem] << 48);
+            zh ^= context->HH[lo];
+            zl ^= context->HL[lo];
+        }
+
+        rem = (unsigned char)(zl & 0x0f);
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ ((uint64_t)last4[rem] << 48);
+        zh ^= context->HH[hi];
+        zl ^= context->HL[hi];
+    }
+
+    store64(X, zh);
+    store64(X + 8, zl);
+}
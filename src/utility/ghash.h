@@ -0,0 +1,30 @@
+#ifndef GHASH_H
+#define GHASH_H
+
+/*
+   GHASH multiplication in GF(2^128) for AES-GCM,
+   see NIST Special Publication 800-38D 6.3 and 6.4.
+
+   Uses Shoup's method with a 4-bit table of multiples
+   of the hash subkey H (256 bytes per key).
+ */
+
+#include "stdint.h"
+
+typedef struct
+{
+    uint64_t HL[16];
+    uint64_t HH[16];
+} GHASH_CTX;
+
+void GHASHInit(
+    GHASH_CTX * context,
+    const unsigned char H[16]
+    );
+
+void GHASHMultiply(
+    const GHASH_CTX * context,
+    unsigned char X[16]
+    );
+
+#endif /* GHASH_H */